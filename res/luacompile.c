@@ -0,0 +1,137 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Compile a Lua script into a precompiled chunk for the resource pack.
+ *
+ * Usage: luacompile <output> <input> <name>
+ *
+ * The name should be the virtual filename of the script, so the chunk has
+ * the same name that the game would have given the source.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+/**
+ * Write out part of a dumped chunk
+ */
+static int luacompile_write(lua_State* L, const void* p, size_t size, void* ud) {
+    (void)L;
+    return (size != 0 && fwrite(p, size, 1, (FILE*)ud) != 1);
+}
+
+/**
+ * Read an entire file into memory
+ *
+ * The returned buffer must be freed by the caller.
+ */
+static char* luacompile_read(const char* filename, size_t* size) {
+    FILE* fh = NULL;
+    char* data = NULL;
+
+    if ((fh = fopen(filename, "rb")) == NULL) {
+        goto fail;
+    }
+    if (fseek(fh, 0, SEEK_END) != 0) {
+        goto fail;
+    }
+    long length = ftell(fh);
+    if (length < 0 || fseek(fh, 0, SEEK_SET) != 0) {
+        goto fail;
+    }
+
+    // Allocate at least one byte, so an empty script isn't an error.
+    if ((data = malloc(length + 1)) == NULL) {
+        goto fail;
+    }
+    if (fread(data, 1, length, fh) != (size_t)length) {
+        goto fail;
+    }
+
+    fclose(fh);
+    *size = length;
+    return data;
+
+fail:
+    if (fh != NULL) {
+        fclose(fh);
+    }
+    free(data);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    lua_State* L = NULL;
+    char* source = NULL;
+    FILE* out = NULL;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <output> <input> <name>\n", argv[0]);
+        goto fail;
+    }
+
+    size_t size = 0;
+    if ((source = luacompile_read(argv[2], &size)) == NULL) {
+        fprintf(stderr, "%s: could not read %s\n", argv[0], argv[2]);
+        goto fail;
+    }
+
+    if ((L = luaL_newstate()) == NULL) {
+        fprintf(stderr, "%s: could not create Lua state\n", argv[0]);
+        goto fail;
+    }
+
+    // Debug information is kept, so errors still have line numbers.
+    if (luaL_loadbufferx(L, source, size, argv[3], "t") != LUA_OK) {
+        fprintf(stderr, "%s: %s\n", argv[0], lua_tostring(L, -1));
+        goto fail;
+    }
+
+    if ((out = fopen(argv[1], "wb")) == NULL) {
+        fprintf(stderr, "%s: could not open %s\n", argv[0], argv[1]);
+        goto fail;
+    }
+    int status = lua_dump(L, luacompile_write, out, 0);
+    if (fclose(out) != 0) {
+        status = 1;
+    }
+    out = NULL;
+    if (status != 0) {
+        fprintf(stderr, "%s: could not write %s\n", argv[0], argv[1]);
+        remove(argv[1]);
+        goto fail;
+    }
+
+    lua_close(L);
+    free(source);
+    return EXIT_SUCCESS;
+
+fail:
+    if (out != NULL) {
+        fclose(out);
+        remove(argv[1]);
+    }
+    if (L != NULL) {
+        lua_close(L);
+    }
+    free(source);
+    return EXIT_FAILURE;
+}
@@ -20,28 +20,190 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "lua.h"
 #include "mpack.h"
 
 #include "entity.h"
 #include "error.h"
+#include "kicks.h"
 #include "piece.h"
 #include "ruleset.h"
+#include "serialize.h"
+
+/**
+ * Recalculate the well depth of every column from the column heights.
+ */
+static void board_update_wells(board_t* board) {
+    int16_t* heights = board->data.heights;
+    int width = board->config.width;
+
+    for (int x = 0;x < width;x++) {
+        int left = (x > 0) ? heights[x - 1] : board->config.height;
+        int right = (x < width - 1) ? heights[x + 1] : board->config.height;
+        int depth = ((left < right) ? left : right) - heights[x];
+        board->data.wells[x] = (depth > 0) ? depth : 0;
+    }
+}
+
+/**
+ * Recalculate the height of every column from the row masks.
+ */
+static void board_update_heights(board_t* board) {
+    // Columns that we haven't found the top of yet.
+    rowmask_t remain = board->data.full_row;
+
+    memset(board->data.heights, 0, board->config.width * sizeof(int16_t));
+    for (int y = 0;y < board->config.height && remain != 0;y++) {
+        rowmask_t found = board->data.rows[y] & remain;
+        remain &= ~found;
+        while (found != 0) {
+            int x = rowmask_ctz(found);
+            found &= found - 1;
+            board->data.heights[x] = board->config.height - y;
+        }
+    }
+
+    board_update_wells(board);
+}
+
+/**
+ * Allocates a board configuration from the table at the top of the Lua stack
+ *
+ * Assumes you have a board configuration table on the top of the Lua stack.
+ * Consumes the table from the Lua stack and leaves nothing on success, or
+ * an error message on failure.
+ */
+board_config_t* board_config_new(lua_State* L) {
+    int top = lua_gettop(L);
+
+    const char* error = NULL;
+    board_config_t* config = NULL;
+
+    lua_getfield(L, -1, "width");
+    lua_Integer width = lua_tointeger(L, -1);
+    lua_pop(L, 1); // pop width
+
+    lua_getfield(L, -1, "height");
+    lua_Integer height = lua_tointeger(L, -1);
+    lua_pop(L, 1); // pop height
+
+    // Visible height is optional, and defaults to the whole board.
+    lua_getfield(L, -1, "visible_height");
+    lua_Integer visible_height = lua_isnil(L, -1) ? height : lua_tointeger(L, -1);
+    lua_pop(L, 1); // pop visible_height
+
+    // Every row of the board has to fit inside a single row mask, and every
+    // row of the board has to fit inside a cleared row bitmap.
+    if (width <= 0 || width > ROWMASK_WIDTH) {
+        error = "Board \"width\" is out of range";
+        goto fail;
+    }
+    if (height <= 0 || height > MAX_BOARD_HEIGHT) {
+        error = "Board \"height\" is out of range";
+        goto fail;
+    }
+    if (visible_height <= 0 || visible_height > height) {
+        error = "Board \"visible_height\" is out of range";
+        goto fail;
+    }
+    lua_pop(L, 1); // pop board table
+
+    config = calloc(1, sizeof(board_config_t));
+    if (config == NULL) {
+        error = "Allocation error";
+        goto fail;
+    }
+
+    config->width = (int16_t)width;
+    config->height = (int16_t)height;
+    config->visible_height = (int16_t)visible_height;
+
+    return config;
+
+fail:
+    lua_settop(L, top); // reset stack to previous position
+    lua_pushstring(L, error); // push error
+    board_config_delete(config);
+    return NULL;
+}
+
+/**
+ * Frees a board configuration
+ */
+void board_config_delete(board_config_t* board_config) {
+    free(board_config);
+}
+
+/**
+ * A generic destructor for the board configuration
+ */
+void board_config_destruct(void* board_config) {
+    board_config_delete((board_config_t*)board_config);
+}
+
+/**
+ * Id of the next board to be created.
+ */
+static size_t g_next_board_id = 1;
+
+/**
+ * Hash the contents of a single row of the board.
+ *
+ * The row is mixed together with its position, so identical rows at
+ * different heights don't cancel each other out.
+ */
+static uint64_t board_hash_row(int y, rowmask_t row) {
+    if (row == 0) {
+        // Empty rows don't contribute to the hash.
+        return 0;
+    }
+
+    // splitmix64 finalizer.
+    uint64_t hash = row ^ ((uint64_t)(y + 1) * 0x9E3779B97F4A7C15ULL);
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * Mark rows of the board as changed.
+ *
+ * The hash of the board is brought up to date with the new contents of the
+ * changed rows, so the row masks must already be written.
+ */
+static void board_touch_rows(board_t* board, uint64_t rows) {
+    board->generation += 1;
+    board->dirty |= rows;
+    while (rows != 0) {
+        int y = rowmask_ctz(rows);
+        rows &= rows - 1;
+        board->data.generations[y] = board->generation;
+
+        uint64_t hash = board_hash_row(y, board->data.rows[y]);
+        board->hash ^= board->data.hashes[y] ^ hash;
+        board->data.hashes[y] = hash;
+    }
+}
 
 /**
  * Create a new board structure.
+ *
+ * The configuration is copied into the board, so it doesn't have to outlive
+ * the board.
  */
-board_t* board_new(void) {
+board_t* board_new(const board_config_t* config) {
     board_t* board = NULL;
 
-    if ((board = calloc(1, sizeof(*board))) == NULL) {
-        error_push_allocerr();
+    if ((board = entity_pool_alloc(MINO_ENTITY_BOARD, sizeof(*board))) == NULL) {
         goto fail;
     }
 
+    // Every board gets an id that is never reused, so anything that caches
+    // what it knows about a board can tell boards apart.
+    board->id = g_next_board_id++;
+
     // Define our configuration
-    board->config.width = 10;
-    board->config.height = 22;
-    board->config.visible_height = 20;
+    board->config = *config;
     board->piece_count = 0;
 
     // Based on that configuration, construct the board itself
@@ -53,6 +215,40 @@ board_t* board_new(void) {
         goto fail;
     }
 
+    // Every row also gets an occupancy mask.
+    board->data.rows = calloc(board->config.height, sizeof(rowmask_t));
+    if (board->data.rows == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+    board->data.full_row = ~(rowmask_t)0 >> (ROWMASK_WIDTH - board->config.width);
+
+    // Column heights and wells are kept up to date as the board changes.
+    board->data.heights = calloc(board->config.width, sizeof(int16_t));
+    board->data.wells = calloc(board->config.width, sizeof(int16_t));
+    if (board->data.heights == NULL || board->data.wells == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+    board_update_wells(board);
+
+    // Every row starts out dirty, so the first reader sees the whole board.
+    board->data.generations = calloc(board->config.height, sizeof(uint32_t));
+    if (board->data.generations == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+    board->dirty = ~(uint64_t)0 >> (MAX_BOARD_HEIGHT - board->config.height);
+    board->generation = 0;
+
+    // An empty board hashes to 0.
+    board->data.hashes = calloc(board->config.height, sizeof(uint64_t));
+    if (board->data.hashes == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+    board->hash = 0;
+
     // Initialize board pieces
     for (size_t i = 0;i < MAX_BOARD_PIECES;i++) {
         board->pieces[i].handle = handle_empty();
@@ -61,9 +257,9 @@ board_t* board_new(void) {
         board->pieces[i].alpha = 255;
     }
 
-    // Ghost piece
-    // FIXME: Stop hardcoding this
-    board->pieces[1].alpha = 127;
+    // No ghost piece until one is asked for.
+    board->ghost = MAX_BOARD_PIECES;
+    board->ghost_source = 0;
 
     return board;
 
@@ -72,6 +268,46 @@ fail:
     return NULL;
 }
 
+/**
+ * Create a copy of a board.
+ *
+ * The copy has its own id and shares the entity manager of the original.
+ * Pieces on the board are referred to by handle, so the copy refers to the
+ * same pieces as the original.
+ */
+board_t* board_clone(const board_t* board) {
+    board_t* clone = board_new(&board->config);
+    if (clone == NULL) {
+        return NULL;
+    }
+
+    clone->manager = board->manager;
+
+    int width = board->config.width;
+    int height = board->config.height;
+    memcpy(clone->data.data, board->data.data, board->data.size);
+    memcpy(clone->data.rows, board->data.rows, height * sizeof(rowmask_t));
+    memcpy(clone->data.heights, board->data.heights, width * sizeof(int16_t));
+    memcpy(clone->data.wells, board->data.wells, width * sizeof(int16_t));
+    memcpy(clone->data.generations, board->data.generations, height * sizeof(uint32_t));
+    memcpy(clone->data.hashes, board->data.hashes, height * sizeof(uint64_t));
+
+    memcpy(clone->pieces, board->pieces, sizeof(board->pieces));
+    clone->piece_count = board->piece_count;
+    clone->ghost = board->ghost;
+    clone->ghost_source = board->ghost_source;
+
+    memcpy(clone->garbage, board->garbage, sizeof(board->garbage));
+    clone->garbage_head = board->garbage_head;
+    clone->garbage_count = board->garbage_count;
+
+    clone->dirty = board->dirty;
+    clone->generation = board->generation;
+    clone->hash = board->hash;
+
+    return clone;
+}
+
 /**
  * Delete a board structure.
  */
@@ -80,14 +316,26 @@ void board_delete(board_t* board) {
         return;
     }
 
+    // Don't chase the ghost piece's source while we tear down the pieces.
+    board->ghost = MAX_BOARD_PIECES;
     for (size_t i = 0;i < MAX_BOARD_PIECES;i++) {
         board_unset_piece(board, i);
     }
 
     free(board->data.data);
     board->data.data = NULL;
-
-    free(board);
+    free(board->data.rows);
+    board->data.rows = NULL;
+    free(board->data.heights);
+    board->data.heights = NULL;
+    free(board->data.wells);
+    board->data.wells = NULL;
+    free(board->data.generations);
+    board->data.generations = NULL;
+    free(board->data.hashes);
+    board->data.hashes = NULL;
+
+    entity_pool_free(MINO_ENTITY_BOARD, board);
 }
 
 /**
@@ -156,6 +404,10 @@ bool board_set_piece(board_t* board, size_t index, handle_t handle) {
     board->pieces[index].pos = piece->config->spawn_pos;
     board->pieces[index].rot = piece->config->spawn_rot;
 
+    if (index == board->ghost_source) {
+        board_update_ghost(board);
+    }
+
     return true;
 }
 
@@ -177,6 +429,10 @@ bool board_unset_piece(board_t* board, size_t index) {
     board->pieces[index].pos = vec2i_zero();
     board->pieces[index].rot = 0;
 
+    if (index == board->ghost_source) {
+        board_update_ghost(board);
+    }
+
     return true;
 }
 
@@ -200,6 +456,24 @@ boardpiece_t* board_get_boardpiece(board_t* board, size_t index) {
     return &board->pieces[index];
 }
 
+/**
+ * Shift a row mask of a piece into position on the board.
+ *
+ * The caller is responsible for making sure the piece is inside the board
+ * horizontally, so no part of the mask can be shifted out.
+ */
+static inline rowmask_t board_shift_mask(rowmask_t mask, int x) {
+    return (x < 0) ? (mask >> -x) : (mask << x);
+}
+
+/**
+ * Test to see if a piece shape is completely inside the board.
+ */
+static inline bool board_shape_inside(const board_t* board, const piece_shape_t* shape, vec2i_t pos) {
+    return pos.x + shape->min.x >= 0 && pos.x + shape->max.x < board->config.width &&
+           pos.y + shape->min.y >= 0 && pos.y + shape->max.y < board->config.height;
+}
+
 /**
  * Board collision test given a piece and an orientation.
  * 
@@ -207,39 +481,90 @@ boardpiece_t* board_get_boardpiece(board_t* board, size_t index) {
  * otherwise false.
  */
 bool board_test_piece(const board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot) {
-    for (size_t i = 0;i < piece->data_size;i++) {
-        // Get the source cell.
-        uint8_t* scell = piece_config_get_rot(piece, rot) + i;
-        if (!*scell) {
-            // Source cell is empty, no collision test necessary.
-            continue;
-        }
+    const piece_shape_t* shape = piece_config_get_shape(piece, rot);
 
-        // Source cell location.
-        int sx = i % piece->width;
-        int sy = i / piece->width;
+    // Check to see if we're off the board.
+    if (!board_shape_inside(board, shape, pos)) {
+        // An empty piece can't collide with anything.
+        return shape->cell_count == 0;
+    }
 
-        // Check to see if we're off the board.
-        if (pos.x + sx < 0 || pos.x + sx >= board->config.width ||
-            pos.y + sy < 0 || pos.y + sy >= board->config.height) {
+    // Test only the rows that the piece actually occupies.
+    const rowmask_t* rows = board->data.rows + pos.y;
+    for (int sy = shape->min.y;sy <= shape->max.y;sy++) {
+        if (rows[sy] & board_shift_mask(shape->rows[sy], pos.x)) {
+            // Got a hit!
             return false;
         }
+    }
 
-        // Figure out the destination cell.
-        uint8_t* dcell = board->data.data;
-        dcell += pos.y * board->config.width + pos.x;
-        dcell += sy * board->config.width + sx;
+    // All parts of the piece fit on the position on the board.
+    return true;
+}
 
-        if (!*dcell) {
-            // Destination cell is empty, collision passes.
-            continue;
+/**
+ * Test a batch of positions offset from a single position, in order.
+ *
+ * Returns the index of the first offset where the piece fits, or -1 if the
+ * piece doesn't fit anywhere.
+ */
+int board_test_positions(const board_t* board, const piece_config_t* piece, vec2i_t pos,
+                         uint8_t rot, const vec2i_t* offsets, size_t count) {
+    for (size_t i = 0;i < count;i++) {
+        vec2i_t test = vec2i(pos.x + offsets[i].x, pos.y + offsets[i].y);
+        if (board_test_piece(board, piece, test, rot)) {
+            return (int)i;
         }
+    }
+
+    return -1;
+}
 
-        // Got a hit!
+/**
+ * Rotate a board piece, kicking it into place if necessary.
+ *
+ * The piece takes the first of its wallkick tests that fits.  Pieces without
+ * kicks only rotate in place.  Direction is a rotate_dir_t.
+ *
+ * Returns true if the piece was rotated, otherwise false.
+ */
+bool board_rotate_piece(board_t* board, size_t index, int dir) {
+    boardpiece_t* bpiece = board_get_boardpiece(board, index);
+    if (bpiece == NULL || dir < 0 || dir >= MINO_ROTATE_MAX) {
         return false;
     }
 
-    // All parts of the piece fit on the position on the board.
+    entity_t* entity = entity_manager_get(board->manager, bpiece->handle);
+    if (entity == NULL || entity->config.type != MINO_ENTITY_PIECE) {
+        return false;
+    }
+    const piece_config_t* config = ((piece_t*)entity->data)->config;
+
+    uint8_t rot = (dir == MINO_ROTATE_CW) ?
+        (bpiece->rot + 1) % config->data_count :
+        (bpiece->rot + config->data_count - 1) % config->data_count;
+
+    // Pieces without kicks only get the one test.
+    static const vec2i_t in_place[] = { { 0, 0 } };
+    const vec2i_t* tests = in_place;
+    size_t test_count = 1;
+    if (config->kicks != NULL) {
+        tests = kicks_config_get_tests(config->kicks, bpiece->rot, dir);
+        test_count = config->kicks->test_count;
+    }
+
+    int i = board_test_positions(board, config, bpiece->pos, rot, tests, test_count);
+    if (i < 0) {
+        return false;
+    }
+
+    bpiece->pos.x += tests[i].x;
+    bpiece->pos.y += tests[i].y;
+    bpiece->rot = rot;
+    if (index == board->ghost_source) {
+        board_update_ghost(board);
+    }
+
     return true;
 }
 
@@ -287,15 +612,10 @@ vec2i_t board_test_piece_between(const board_t* board, const piece_config_t* pie
             ret.x = i;
         }
     } else if (delta.y > 0) {
-        // Loop along the positive y coordinate.
-        for (int i = src.y + 1;i <= dst.y;i++) {
-            pos.x = ret.x;
-            pos.y = i;
-            if (!board_test_piece(board, piece, pos, rot)) {
-                return ret;
-            }
-            ret.y = i;
-        }
+        // Moving down is common enough to have its own fast path.
+        int distance = board_drop_distance(board, piece, src, rot);
+        ret.y += (distance < delta.y) ? distance : delta.y;
+        return ret;
     } else if (delta.y < 0) {
         // Loop along the negative y coordinate.
         for (int i = src.y - 1;i >= dst.y;i--) {
@@ -313,132 +633,1147 @@ vec2i_t board_test_piece_between(const board_t* board, const piece_config_t* pie
 }
 
 /**
- * Lock a piece in a particular spot.
- * 
- * Note that no collision detection is done.  Any existing blocks will be
- * overwritten.
+ * Get the height of the stack in a column of the board.
+ *
+ * Out-of-bounds columns are always the full height of the board.
  */
-void board_lock_piece(const board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot) {
-    for (size_t i = 0;i < piece->data_size;i++) {
-        // Get the source cell.
-        uint8_t* scell = piece_config_get_rot(piece, rot) + i;
-        if (!*scell) {
-            // Source cell is empty, do nothing.
-            continue;
-        }
-
-        // Source cell location.
-        int sx = i % piece->width;
-        int sy = i / piece->width;
-
-        // Check to see if we're off the board.
-        if (pos.x + sx < 0 || pos.x + sx >= board->config.width ||
-            pos.y + sy < 0 || pos.y + sy >= board->config.height) {
-            continue;
-        }
+int board_get_height(const board_t* board, int x) {
+    if (x < 0 || x >= board->config.width) {
+        return board->config.height;
+    }
 
-        // Figure out the destination cell.
-        uint8_t* dcell = board->data.data;
-        dcell += pos.y * board->config.width + pos.x;
-        dcell += sy * board->config.width + sx;
+    return board->data.heights[x];
+}
 
-        // Write our piece cell into the destination cell.
-        *dcell = *scell;
+/**
+ * Get the depth of the well in a column of the board.
+ *
+ * Out-of-bounds columns never have a well.
+ */
+int board_get_well(const board_t* board, int x) {
+    if (x < 0 || x >= board->config.width) {
+        return 0;
     }
+
+    return board->data.wells[x];
 }
 
 /**
- * Clear the board of any lines.
- * 
- * TODO: Somehow we need to account for a fancy line-clear animation that
- *       happens over many frames.
- * 
- * Returns the number of lines cleared.
+ * Find how many rows a piece can fall from a position before it collides
+ * with something.
+ *
+ * If every column of the piece is above the stack, this is answered straight
+ * from the column heights.  Otherwise, for example when the piece is tucked
+ * under an overhang, we fall back to testing one row at a time.
  */
-uint8_t board_clear_lines(board_t* board) {
-    uint8_t lines = 0;
+int board_drop_distance(const board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot) {
+    const piece_shape_t* shape = piece_config_get_shape(piece, rot);
 
-    for (size_t i = 0;i < board->data.size;i += board->config.width) {
-        // Find an empty cell in the row
-        bool found_empty = false;
-        for (size_t x = 0 ;x < board->config.width;x++) {
-            if (!*(board->data.data + i + x)) {
-                found_empty = true;
+    if (shape->cell_count == 0) {
+        // An empty piece can fall forever, so stop it at the bottom.
+        int distance = board->config.height - 1 - pos.y;
+        return (distance > 0) ? distance : 0;
+    }
+
+    if (board_shape_inside(board, shape, pos)) {
+        int distance = board->config.height;
+        int x;
+        for (x = shape->min.x;x <= shape->max.x;x++) {
+            if (shape->bottoms[x] < 0) {
+                continue;
+            }
+
+            // First occupied row of the column, or the floor.
+            int bx = pos.x + x;
+            int top = board->config.height - board->data.heights[bx];
+            int by = pos.y + shape->bottoms[x];
+            if (by >= top) {
+                // Piece is not above the stack in this column.
                 break;
             }
+
+            if (top - 1 - by < distance) {
+                distance = top - 1 - by;
+            }
+        }
+
+        if (x > shape->max.x) {
+            return distance;
         }
+    }
+
+    // Slow path, test every row until we collide.
+    int distance = 0;
+    vec2i_t test = pos;
+    for (;;) {
+        test.y += 1;
+        if (!board_test_piece(board, piece, test, rot)) {
+            return distance;
+        }
+        distance += 1;
+    }
+}
 
-        if (found_empty == false) {
-            // Move the contents of the board forward over the full line.
-            uint8_t* dest = board->data.data + board->config.width;
-            memmove(dest, board->data.data, i); // overlapping regions
+/**
+ * Get the rows that have changed since the dirty rows were last reset.
+ *
+ * Bit n of the result is row n of the board.
+ */
+uint64_t board_get_dirty(const board_t* board) {
+    return board->dirty;
+}
 
-            // Fill the first line with empty space.
-            memset(board->data.data, 0, board->config.width);
+/**
+ * Forget about any rows that have changed.
+ */
+void board_reset_dirty(board_t* board) {
+    board->dirty = 0;
+}
 
-            // We have cleared one additional line.
-            lines += 1;
+/**
+ * Get the current generation of the board.
+ */
+uint32_t board_get_generation(const board_t* board) {
+    return board->generation;
+}
+
+/**
+ * Get the rows that have changed after a given generation of the board.
+ *
+ * Bit n of the result is row n of the board.
+ */
+uint64_t board_get_changed(const board_t* board, uint32_t since) {
+    uint64_t changed = 0;
+
+    if (since == board->generation) {
+        // Nothing has happened since.
+        return 0;
+    }
+
+    for (int y = 0;y < board->config.height;y++) {
+        if ((int32_t)(board->data.generations[y] - since) > 0) {
+            changed |= (uint64_t)1 << y;
         }
     }
 
-    return lines;
+    return changed;
 }
 
 /**
- * Serialize board struct using msgpack
+ * Get the hash of the contents of the board.
+ *
+ * Two boards with the same cells occupied have the same hash, no matter how
+ * they got there.
  */
-void board_serialize(board_t* board, mpack_writer_t* writer) {
-    mpack_write_bin(writer, (const char*)board->data.data, board->data.size);
+uint64_t board_get_hash(const board_t* board) {
+    return board->hash;
 }
 
 /**
- * Unserialize random struct using msgpack
+ * Measure the features of the stack on the board.
+ *
+ * Everything is worked out from the row masks and column heights, so this
+ * only takes a couple of passes over the rows of the board.
  */
-board_t* board_unserialize(serialize_t* ser, mpack_reader_t* reader) {
-    board_t* board = NULL;
+void board_evaluate(const board_t* board, board_eval_t* eval) {
+    const rowmask_t* rows = board->data.rows;
+    rowmask_t full_row = board->data.full_row;
+    int width = board->config.width;
+    int height = board->config.height;
+    rowmask_t holes[MAX_BOARD_HEIGHT];
+
+    memset(eval, 0, sizeof(*eval));
+
+    // From the top down, any empty cell under a column we've seen a block in
+    // is a hole.
+    rowmask_t above = 0;
+    for (int y = 0;y < height;y++) {
+        holes[y] = above & ~rows[y];
+        above |= rows[y];
+        eval->holes += rowmask_popcount(holes[y]);
+
+        // Transitions inside the row, plus against either wall.
+        rowmask_t changes = (rows[y] ^ (rows[y] >> 1)) & (full_row >> 1);
+        eval->row_transitions += rowmask_popcount(changes);
+        eval->row_transitions += (rows[y] & 1) == 0;
+        eval->row_transitions += (rows[y] >> (width - 1) & 1) == 0;
+
+        // Transitions against the row below, or against the floor.
+        rowmask_t below = (y < height - 1) ? rows[y + 1] : full_row;
+        eval->column_transitions += rowmask_popcount(rows[y] ^ below);
+    }
 
-    if ((board = calloc(1, sizeof(*board))) == NULL) {
-        error_push_allocerr();
-        goto fail;
+    // From the bottom up, any block over a column we've seen a hole in is
+    // covering it.
+    rowmask_t under = 0;
+    for (int y = height - 1;y >= 0;y--) {
+        eval->covered += rowmask_popcount(rows[y] & under);
+        under |= holes[y];
     }
 
-    uint32_t size = mpack_expect_bin(reader);
-    mpack_read_bytes(reader, (char*)board->data.data, board->data.size);
+    for (int x = 0;x < width;x++) {
+        int column = board->data.heights[x];
+        eval->aggregate_height += column;
+        if (column > eval->max_height) {
+            eval->max_height = column;
+        }
+        if (x < width - 1) {
+            int diff = column - board->data.heights[x + 1];
+            eval->bumpiness += (diff < 0) ? -diff : diff;
+        }
 
-    return board;
+        int well = board->data.wells[x];
+        eval->well_sum += well;
+        if (well > eval->max_well) {
+            eval->max_well = well;
+        }
+    }
+}
 
-fail:
-    return NULL;
+/**
+ * Count the occupied corners of the box around a piece on the board.
+ *
+ * Corners outside of the board count as occupied.  For a three-wide piece
+ * this is the usual three-corner spin test.  Returns -1 if there is no
+ * piece at the index.
+ */
+int board_count_corners(const board_t* board, size_t index) {
+    if (index >= MAX_BOARD_PIECES || board->pieces[index].handle == handle_empty()) {
+        return -1;
+    }
+    const boardpiece_t* bpiece = &board->pieces[index];
+
+    entity_t* entity = entity_manager_get(board->manager, bpiece->handle);
+    if (entity == NULL || entity->config.type != MINO_ENTITY_PIECE) {
+        return -1;
+    }
+    const piece_config_t* config = ((piece_t*)entity->data)->config;
+
+    int left = bpiece->pos.x;
+    int right = bpiece->pos.x + config->width - 1;
+    int top = bpiece->pos.y;
+    int bottom = bpiece->pos.y + config->height - 1;
+    const vec2i_t corners[] = {
+        { left, top }, { right, top }, { left, bottom }, { right, bottom }
+    };
+
+    int count = 0;
+    for (size_t i = 0;i < ARRAY_LEN(corners);i++) {
+        int x = corners[i].x;
+        int y = corners[i].y;
+        if (x < 0 || x >= board->config.width || y < 0 || y >= board->config.height) {
+            count += 1;
+        } else if (board->data.rows[y] & ((rowmask_t)1 << x)) {
+            count += 1;
+        }
+    }
+
+    return count;
 }
 
+/**
+ * State of a placement search.
+ */
+typedef struct {
+    /**
+     * Size of the search space on each axis.
+     */
+    int span_x;
+    int span_y;
+
+    /**
+     * Offset added to every position to keep indexes positive.
+     */
+    vec2i_t offset;
+
+    /**
+     * Bitset of every position and rotation we have already queued.
+     */
+    uint8_t* visited;
+
+    /**
+     * Queue of position and rotation indexes to search from.
+     */
+    uint32_t* queue;
+    size_t head;
+    size_t tail;
+} board_search_t;
 
 /**
- * Wrap serialize with void* function.
+ * Queue up a position and rotation, unless we've seen it before.
  */
-static void wrapserialize(void* ptr, mpack_writer_t* writer) {
-    board_serialize(ptr, writer);
+static void board_search_push(board_search_t* search, vec2i_t pos, uint8_t rot) {
+    uint32_t s = ((uint32_t)rot * search->span_y + pos.y + search->offset.y) * search->span_x +
+                 pos.x + search->offset.x;
+    if (search->visited[s >> 3] & (1 << (s & 7))) {
+        return;
+    }
+
+    search->visited[s >> 3] |= 1 << (s & 7);
+    search->queue[search->tail++] = s;
 }
 
 /**
- * Wrap delete with void* function.
+ * Take the next position and rotation off of the queue.
  */
-static void wrapdelete(void* ptr) {
-    board_delete(ptr);
+static void board_search_pop(board_search_t* search, vec2i_t* pos, uint8_t* rot) {
+    uint32_t s = search->queue[search->head++];
+    pos->x = (int)(s % search->span_x) - search->offset.x;
+    pos->y = (int)((s / search->span_x) % search->span_y) - search->offset.y;
+    *rot = (uint8_t)(s / search->span_x / search->span_y);
 }
 
 /**
- * Initialize an entity with random config
+ * Find every place a piece can lock from its spawn position.
+ *
+ * This is a breadth-first search over every position and rotation the piece
+ * can reach by shifting, soft dropping and rotating with the given kicks, so
+ * tucks and spins are found too.  Kicks can be NULL, in which case rotations
+ * are only tried in place.
+ *
+ * Returns an allocated array of placements that the caller must free, with
+ * the number of placements written to count.  Returns NULL on error.
  */
-bool board_entity_init(entity_t* entity, entity_manager_t* manager) {
-    board_t* board = board_new();
-    if (board == NULL) {
-        return false;
+board_placement_t* board_find_placements(const board_t* board, const piece_config_t* piece,
+                                         const kicks_config_t* kicks, size_t* count) {
+    board_search_t search = { 0 };
+    board_placement_t* placements = NULL;
+    *count = 0;
+
+    if (kicks != NULL && kicks->rot_count != piece->data_count) {
+        error_push("Kicks \"%s\" don't fit piece \"%s\".", kicks->name, piece->name);
+        goto fail;
     }
 
-    entity->config.type = MINO_ENTITY_BOARD;
-    entity->config.serialize = wrapserialize;
-    entity->config.destruct = wrapdelete;
-    entity->data = board;
+    for (uint8_t r = 0;r < piece->data_count;r++) {
+        if (piece_config_get_shape(piece, r)->cell_count == 0) {
+            // An empty piece can go anywhere, so there's no sense searching.
+            error_push("Piece \"%s\" has an empty rotation.", piece->name);
+            goto fail;
+        }
+    }
 
-    return true;
+    // A piece can hang off the top and left of the board by up to its own
+    // size, so offset every position by that much to index the search space.
+    search.span_x = board->config.width + piece->width;
+    search.span_y = board->config.height + piece->height;
+    search.offset = vec2i(piece->width, piece->height);
+    size_t states = (size_t)search.span_x * search.span_y * piece->data_count;
+
+    search.visited = calloc((states + 7) / 8, sizeof(uint8_t));
+    search.queue = calloc(states, sizeof(uint32_t));
+    placements = calloc(states, sizeof(board_placement_t));
+    if (search.visited == NULL || search.queue == NULL || placements == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+
+    if (board_test_piece(board, piece, piece->spawn_pos, piece->spawn_rot)) {
+        board_search_push(&search, piece->spawn_pos, piece->spawn_rot);
+    }
+
+    while (search.head < search.tail) {
+        vec2i_t pos;
+        uint8_t rot;
+        board_search_pop(&search, &pos, &rot);
+
+        // Shifts.
+        vec2i_t test = vec2i(pos.x - 1, pos.y);
+        if (board_test_piece(board, piece, test, rot)) {
+            board_search_push(&search, test, rot);
+        }
+        test = vec2i(pos.x + 1, pos.y);
+        if (board_test_piece(board, piece, test, rot)) {
+            board_search_push(&search, test, rot);
+        }
+
+        // Soft drop, or lock if we can't move down any further.
+        test = vec2i(pos.x, pos.y + 1);
+        if (board_test_piece(board, piece, test, rot)) {
+            board_search_push(&search, test, rot);
+        } else {
+            placements[*count].pos = pos;
+            placements[*count].rot = rot;
+            *count += 1;
+        }
+
+        // Rotations, which take the first test that fits.
+        for (int dir = 0;dir < MINO_ROTATE_MAX;dir++) {
+            uint8_t nrot = (dir == MINO_ROTATE_CW) ?
+                (rot + 1) % piece->data_count :
+                (rot + piece->data_count - 1) % piece->data_count;
+            if (nrot == rot) {
+                continue;
+            }
+
+            const vec2i_t* tests = NULL;
+            uint8_t test_count = 1;
+            if (kicks != NULL) {
+                tests = kicks_config_get_tests(kicks, rot, dir);
+                test_count = kicks->test_count;
+            }
+
+            for (uint8_t i = 0;i < test_count;i++) {
+                test = pos;
+                if (tests != NULL) {
+                    test.x += tests[i].x;
+                    test.y += tests[i].y;
+                }
+                if (board_test_piece(board, piece, test, nrot)) {
+                    board_search_push(&search, test, nrot);
+                    break;
+                }
+            }
+        }
+    }
+
+    free(search.visited);
+    free(search.queue);
+    return placements;
+
+fail:
+    free(search.visited);
+    free(search.queue);
+    free(placements);
+    return NULL;
+}
+
+/**
+ * Turn a board piece into the ghost of another board piece.
+ *
+ * From then on, the board keeps the ghost piece in sync with its source
+ * piece and dropped as far as it can go, so there is no need to move it
+ * by hand.  Pass MAX_BOARD_PIECES as the index to get rid of the ghost.
+ */
+bool board_set_ghost(board_t* board, size_t index, size_t source) {
+    if (index > MAX_BOARD_PIECES || source >= MAX_BOARD_PIECES) {
+        // Out of range board piece.
+        return false;
+    }
+
+    if (index == source) {
+        // A piece can't be its own ghost.
+        return false;
+    }
+
+    if (board->ghost < MAX_BOARD_PIECES) {
+        // Release the old ghost slot.
+        size_t old = board->ghost;
+        board->ghost = MAX_BOARD_PIECES;
+        board_unset_piece(board, old);
+        board->pieces[old].alpha = 255;
+    }
+
+    board->ghost = index;
+    board->ghost_source = source;
+    if (index < MAX_BOARD_PIECES) {
+        board->pieces[index].alpha = 127;
+        board_update_ghost(board);
+    }
+
+    return true;
+}
+
+/**
+ * Move the ghost piece to follow its source piece.
+ *
+ * This is called for you whenever the board or the source piece changes
+ * through the board functions.  If you poke at a boardpiece directly, call
+ * this yourself afterwards.
+ */
+void board_update_ghost(board_t* board) {
+    if (board->ghost >= MAX_BOARD_PIECES) {
+        // No ghost piece.
+        return;
+    }
+
+    boardpiece_t* ghost = &board->pieces[board->ghost];
+    const boardpiece_t* source = &board->pieces[board->ghost_source];
+
+    entity_t* entity = NULL;
+    if (source->handle != handle_empty() && board->manager != NULL) {
+        entity = entity_manager_get(board->manager, source->handle);
+    }
+    if (entity == NULL || entity->config.type != MINO_ENTITY_PIECE) {
+        // Nothing to follow.
+        ghost->handle = handle_empty();
+        ghost->pos = vec2i_zero();
+        ghost->rot = 0;
+        return;
+    }
+    const piece_t* piece = entity->data;
+
+    ghost->handle = source->handle;
+    ghost->rot = source->rot;
+    ghost->pos = source->pos;
+    ghost->pos.y += board_drop_distance(board, piece->config, source->pos, source->rot);
+}
+
+/**
+ * Lock a piece in a particular spot.
+ * 
+ * Note that no collision detection is done.  Any existing blocks will be
+ * overwritten.
+ */
+void board_lock_piece(board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot) {
+    const piece_shape_t* shape = piece_config_get_shape(piece, rot);
+    uint64_t touched = 0;
+
+    for (size_t i = 0;i < shape->cell_count;i++) {
+        const piece_cell_t* cell = &shape->cells[i];
+        int x = pos.x + cell->x;
+        int y = pos.y + cell->y;
+
+        // Check to see if we're off the board.
+        if (x < 0 || x >= board->config.width || y < 0 || y >= board->config.height) {
+            continue;
+        }
+
+        // Write our piece cell into the destination cell.
+        board->data.data[y * board->config.width + x] = cell->value;
+        board->data.rows[y] |= (rowmask_t)1 << x;
+        touched |= (uint64_t)1 << y;
+
+        // Locking a piece can only ever raise a column.
+        if (board->config.height - y > board->data.heights[x]) {
+            board->data.heights[x] = board->config.height - y;
+        }
+    }
+
+    if (touched != 0) {
+        board_touch_rows(board, touched);
+    }
+    board_update_wells(board);
+    board_update_ghost(board);
+}
+
+/**
+ * Clear the board of any lines.
+ * 
+ * TODO: Somehow we need to account for a fancy line-clear animation that
+ *       happens over many frames.
+ * 
+ * Returns the number of lines cleared.  If cleared is not NULL, it is filled
+ * with a bitmap of the cleared rows, where bit n is row n of the board as it
+ * was before the clear.
+ */
+uint8_t board_clear_lines(board_t* board, uint64_t* cleared) {
+    uint8_t lines = 0;
+    uint64_t cleared_rows = 0;
+    int width = board->config.width;
+
+    // Walk the board from the bottom up, compacting every row that isn't
+    // full down over the rows that were.  Each surviving row is moved at
+    // most once, no matter how many lines are cleared.
+    int dest = board->config.height - 1;
+    int bottom = -1;
+    for (int y = board->config.height - 1;y >= 0;y--) {
+        if (board->data.rows[y] == board->data.full_row) {
+            // Full line, skip over it.
+            if (bottom < 0) {
+                bottom = y;
+            }
+            cleared_rows |= (uint64_t)1 << y;
+            lines += 1;
+            continue;
+        }
+
+        if (dest != y) {
+            memcpy(board->data.data + dest * width, board->data.data + y * width, width);
+            board->data.rows[dest] = board->data.rows[y];
+        }
+        dest -= 1;
+    }
+
+    // Fill the remaining lines at the top with empty space.
+    if (dest >= 0) {
+        memset(board->data.data, 0, (dest + 1) * width);
+        memset(board->data.rows, 0, (dest + 1) * sizeof(rowmask_t));
+    }
+
+    if (lines > 0) {
+        // Every row above the lowest cleared row has moved.
+        board_touch_rows(board, ~(uint64_t)0 >> (MAX_BOARD_HEIGHT - 1 - bottom));
+        board_update_heights(board);
+        board_update_ghost(board);
+    }
+
+    if (cleared != NULL) {
+        *cleared = cleared_rows;
+    }
+    return lines;
+}
+
+/**
+ * Lock a piece and clear any lines, recording enough to undo it.
+ *
+ * Returns false without touching the board if the piece has too many cells
+ * to be recorded.
+ */
+bool board_apply_placement(board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot,
+                           board_undo_t* undo) {
+    const piece_shape_t* shape = piece_config_get_shape(piece, rot);
+    int width = board->config.width;
+
+    if (shape->cell_count > MAX_BOARD_UNDO_CELLS) {
+        return false;
+    }
+
+    memcpy(undo->heights, board->data.heights, width * sizeof(int16_t));
+    memcpy(undo->wells, board->data.wells, width * sizeof(int16_t));
+
+    // Record every cell that the piece is about to be written over.
+    undo->cell_count = 0;
+    undo->touched = 0;
+    for (size_t i = 0;i < shape->cell_count;i++) {
+        int x = pos.x + shape->cells[i].x;
+        int y = pos.y + shape->cells[i].y;
+        if (x < 0 || x >= width || y < 0 || y >= board->config.height) {
+            continue;
+        }
+
+        board_undo_cell_t* cell = &undo->cells[undo->cell_count++];
+        cell->x = (uint8_t)x;
+        cell->y = (uint8_t)y;
+        cell->value = board->data.data[y * width + x];
+        if ((undo->touched & ((uint64_t)1 << y)) == 0) {
+            undo->touched |= (uint64_t)1 << y;
+            undo->rows[y] = board->data.rows[y];
+        }
+    }
+
+    board_lock_piece(board, piece, pos, rot);
+
+    // Record every row that is about to be cleared.
+    undo->lines = 0;
+    for (int y = 0;y < board->config.height;y++) {
+        if (board->data.rows[y] == board->data.full_row) {
+            memcpy(undo->cleared_data + undo->lines * width, board->data.data + y * width, width);
+            undo->lines += 1;
+        }
+    }
+
+    if (undo->lines > 0) {
+        board_clear_lines(board, &undo->cleared);
+    } else {
+        undo->cleared = 0;
+    }
+
+    return true;
+}
+
+/**
+ * Take back a placement made with board_apply_placement.
+ *
+ * Placements have to be undone in the reverse order that they were applied.
+ */
+void board_undo_placement(board_t* board, const board_undo_t* undo) {
+    int width = board->config.width;
+    uint64_t changed = undo->touched;
+
+    if (undo->lines > 0) {
+        // Walk the board from the top down, moving every surviving row back
+        // up to where it was and putting the cleared rows back in between.
+        // Every surviving row moves up, so nothing is overwritten before it
+        // has been moved, and nothing below the lowest cleared row moved.
+        int src = undo->lines;
+        int line = 0;
+        int bottom = 0;
+        for (int y = 0;line < undo->lines;y++) {
+            if (undo->cleared & ((uint64_t)1 << y)) {
+                memcpy(board->data.data + y * width, undo->cleared_data + line * width, width);
+                board->data.rows[y] = board->data.full_row;
+                line += 1;
+                bottom = y;
+                continue;
+            }
+
+            if (src != y) {
+                memcpy(board->data.data + y * width, board->data.data + src * width, width);
+                board->data.rows[y] = board->data.rows[src];
+            }
+            src += 1;
+        }
+
+        changed |= ~(uint64_t)0 >> (MAX_BOARD_HEIGHT - 1 - bottom);
+    }
+
+    // Put back the cells that the piece was written over, last write first.
+    for (size_t i = undo->cell_count;i > 0;i--) {
+        const board_undo_cell_t* cell = &undo->cells[i - 1];
+        board->data.data[cell->y * width + cell->x] = cell->value;
+    }
+    uint64_t touched = undo->touched;
+    while (touched != 0) {
+        int y = rowmask_ctz(touched);
+        touched &= touched - 1;
+        board->data.rows[y] = undo->rows[y];
+    }
+
+    memcpy(board->data.heights, undo->heights, width * sizeof(int16_t));
+    memcpy(board->data.wells, undo->wells, width * sizeof(int16_t));
+
+    if (changed != 0) {
+        board_touch_rows(board, changed);
+    }
+    board_update_ghost(board);
+}
+
+/**
+ * Push rows of garbage into the bottom of the board.
+ *
+ * Every row is filled with the given value except for the hole column.  If
+ * the hole is outside of the board, the rows are solid.  The rest of the
+ * board is moved up in one go.
+ *
+ * Returns false if any blocks were pushed off the top of the board.
+ */
+bool board_push_garbage(board_t* board, uint8_t lines, uint8_t hole, uint8_t value) {
+    int width = board->config.width;
+    int height = board->config.height;
+    bool ok = true;
+
+    if (lines == 0) {
+        return true;
+    }
+    if (lines > height) {
+        lines = (uint8_t)height;
+    }
+
+    // Anything in the top rows is about to fall off the board.
+    for (int y = 0;y < lines;y++) {
+        if (board->data.rows[y] != 0) {
+            ok = false;
+            break;
+        }
+    }
+
+    // Move the contents of the board up over the top rows.
+    memmove(board->data.data, board->data.data + lines * width, (height - lines) * width);
+    memmove(board->data.rows, board->data.rows + lines, (height - lines) * sizeof(rowmask_t));
+
+    // Fill the bottom rows with garbage.
+    rowmask_t garbage_row = board->data.full_row;
+    if (hole < width) {
+        garbage_row &= ~((rowmask_t)1 << hole);
+    }
+    for (int y = height - lines;y < height;y++) {
+        uint8_t* row = board->data.data + y * width;
+        memset(row, value, width);
+        if (hole < width) {
+            row[hole] = 0;
+        }
+        board->data.rows[y] = garbage_row;
+    }
+
+    // Every row of the board has moved.
+    board_touch_rows(board, ~(uint64_t)0 >> (MAX_BOARD_HEIGHT - height));
+    board_update_heights(board);
+    board_update_ghost(board);
+
+    return ok;
+}
+
+/**
+ * Queue up a garbage attack against the board.
+ *
+ * Attacks must be queued in the order they become ready.  Returns false if
+ * there is no room left for another attack, or if the attack would be ready
+ * before the last attack in the queue.
+ */
+bool board_queue_garbage(board_t* board, uint8_t lines, uint8_t hole, uint32_t ready_tic) {
+    if (board->garbage_count >= MAX_BOARD_GARBAGE) {
+        return false;
+    }
+    if (board->garbage_count > 0) {
+        size_t last = (board->garbage_head + board->garbage_count - 1) % MAX_BOARD_GARBAGE;
+        if (ready_tic < board->garbage[last].ready_tic) {
+            return false;
+        }
+    }
+
+    size_t index = (board->garbage_head + board->garbage_count) % MAX_BOARD_GARBAGE;
+    board->garbage[index].ready_tic = ready_tic;
+    board->garbage[index].lines = lines;
+    board->garbage[index].hole = hole;
+    board->garbage_count += 1;
+
+    return true;
+}
+
+/**
+ * Cancel out pending garbage with an outgoing attack.
+ *
+ * The oldest garbage is cancelled first.  Returns the number of lines of the
+ * attack that were left over after all pending garbage was cancelled.
+ */
+uint8_t board_cancel_garbage(board_t* board, uint8_t lines) {
+    while (lines > 0 && board->garbage_count > 0) {
+        board_garbage_t* garbage = &board->garbage[board->garbage_head];
+        if (garbage->lines > lines) {
+            // Partially cancelled.
+            garbage->lines -= lines;
+            return 0;
+        }
+
+        // Completely cancelled.
+        lines -= garbage->lines;
+        board->garbage_head = (board->garbage_head + 1) % MAX_BOARD_GARBAGE;
+        board->garbage_count -= 1;
+    }
+
+    return lines;
+}
+
+/**
+ * Get the total number of lines of pending garbage.
+ */
+size_t board_get_garbage(const board_t* board) {
+    size_t lines = 0;
+
+    for (size_t i = 0;i < board->garbage_count;i++) {
+        lines += board->garbage[(board->garbage_head + i) % MAX_BOARD_GARBAGE].lines;
+    }
+
+    return lines;
+}
+
+/**
+ * Insert all pending garbage that is ready as of the given gametic.
+ *
+ * If overflow is not NULL, it is set to true if any blocks were pushed off
+ * the top of the board, otherwise false.  Returns the number of lines of
+ * garbage that were inserted.
+ */
+size_t board_insert_garbage(board_t* board, uint32_t tic, uint8_t value, bool* overflow) {
+    size_t lines = 0;
+    bool ok = true;
+
+    while (board->garbage_count > 0) {
+        board_garbage_t* garbage = &board->garbage[board->garbage_head];
+        if (garbage->ready_tic > tic) {
+            // Attacks arrive in order, so nothing past here is ready either.
+            break;
+        }
+
+        if (board_push_garbage(board, garbage->lines, garbage->hole, value) == false) {
+            ok = false;
+        }
+
+        // Pushing garbage never inserts more rows than the board has.
+        if (garbage->lines > board->config.height) {
+            lines += board->config.height;
+        } else {
+            lines += garbage->lines;
+        }
+
+        board->garbage_head = (board->garbage_head + 1) % MAX_BOARD_GARBAGE;
+        board->garbage_count -= 1;
+    }
+
+    if (overflow != NULL) {
+        *overflow = !ok;
+    }
+    return lines;
+}
+
+/**
+ * Largest possible size of an encoded board grid.
+ *
+ * Every row could be an empty row count, followed by a full row of
+ * occupancy and a color for every cell.
+ */
+#define MAX_BOARD_GRID_SIZE (MAX_BOARD_HEIGHT * (1 + ROWMASK_WIDTH / 8 + ROWMASK_WIDTH))
+
+/**
+ * Encode the contents of the board into a compact grid.
+ *
+ * Every occupied row is written as the number of empty rows above it, the
+ * occupancy of the row one bit per cell, and then the color of every
+ * occupied cell from left to right.  Empty rows at the bottom of the board
+ * aren't written at all, so an empty board encodes to nothing.
+ *
+ * The buffer must be at least MAX_BOARD_GRID_SIZE bytes long.  Returns the
+ * number of bytes written.
+ */
+static size_t board_encode_grid(const board_t* board, uint8_t* buffer) {
+    int width = board->config.width;
+    int row_bytes = (width + 7) / 8;
+    size_t size = 0;
+    uint8_t empty = 0;
+
+    for (int y = 0;y < board->config.height;y++) {
+        rowmask_t row = board->data.rows[y];
+        if (row == 0) {
+            empty += 1;
+            continue;
+        }
+
+        buffer[size++] = empty;
+        empty = 0;
+
+        for (int i = 0;i < row_bytes;i++) {
+            buffer[size++] = (uint8_t)(row >> (i * 8));
+        }
+
+        const uint8_t* data = board->data.data + y * width;
+        while (row != 0) {
+            int x = rowmask_ctz(row);
+            row &= row - 1;
+            buffer[size++] = data[x];
+        }
+    }
+
+    return size;
+}
+
+/**
+ * Decode a compact grid into an empty board.
+ *
+ * Returns false if the grid doesn't fit the board.
+ */
+static bool board_decode_grid(board_t* board, const uint8_t* buffer, size_t size) {
+    int width = board->config.width;
+    int row_bytes = (width + 7) / 8;
+    size_t pos = 0;
+    int y = 0;
+
+    while (pos < size) {
+        y += buffer[pos++];
+        if (y >= board->config.height || size - pos < (size_t)row_bytes) {
+            return false;
+        }
+
+        rowmask_t row = 0;
+        for (int i = 0;i < row_bytes;i++) {
+            row |= (rowmask_t)buffer[pos++] << (i * 8);
+        }
+        if (row == 0 || (row & ~board->data.full_row) != 0) {
+            // Empty rows are never written, and cells can't be off the board.
+            return false;
+        }
+        board->data.rows[y] = row;
+
+        uint8_t* data = board->data.data + y * width;
+        while (row != 0) {
+            if (pos >= size) {
+                return false;
+            }
+
+            int x = rowmask_ctz(row);
+            row &= row - 1;
+            data[x] = buffer[pos++];
+        }
+
+        y += 1;
+    }
+
+    return true;
+}
+
+/**
+ * Serialize board struct using msgpack
+ *
+ * The grid is written in its compact encoding.  Pieces and pending garbage
+ * are written as-is.
+ */
+void board_serialize(board_t* board, mpack_writer_t* writer) {
+    uint8_t grid[MAX_BOARD_GRID_SIZE];
+    size_t grid_size = board_encode_grid(board, grid);
+
+    mpack_start_array(writer, 8);
+    mpack_write_u8(writer, (uint8_t)board->config.width);
+    mpack_write_u8(writer, (uint8_t)board->config.height);
+    mpack_write_u8(writer, (uint8_t)board->config.visible_height);
+    mpack_write_bin(writer, (const char*)grid, (uint32_t)grid_size);
+
+    mpack_start_array(writer, MAX_BOARD_PIECES);
+    for (size_t i = 0;i < MAX_BOARD_PIECES;i++) {
+        const boardpiece_t* piece = &board->pieces[i];
+        mpack_start_array(writer, 5);
+        mpack_write_u64(writer, piece->handle);
+        mpack_write_i32(writer, piece->pos.x);
+        mpack_write_i32(writer, piece->pos.y);
+        mpack_write_u8(writer, piece->rot);
+        mpack_write_u8(writer, piece->alpha);
+        mpack_finish_array(writer);
+    }
+    mpack_finish_array(writer);
+
+    mpack_write_u8(writer, (uint8_t)board->ghost);
+    mpack_write_u8(writer, (uint8_t)board->ghost_source);
+
+    mpack_start_array(writer, (uint32_t)board->garbage_count);
+    for (size_t i = 0;i < board->garbage_count;i++) {
+        const board_garbage_t* garbage = &board->garbage[(board->garbage_head + i) % MAX_BOARD_GARBAGE];
+        mpack_start_array(writer, 3);
+        mpack_write_u32(writer, garbage->ready_tic);
+        mpack_write_u8(writer, garbage->lines);
+        mpack_write_u8(writer, garbage->hole);
+        mpack_finish_array(writer);
+    }
+    mpack_finish_array(writer);
+
+    mpack_finish_array(writer);
+}
+
+/**
+ * Unserialize board struct using msgpack
+ *
+ * The board isn't attached to an entity manager, so the caller has to
+ * supply one before the pieces on the board can be looked up.
+ */
+board_t* board_unserialize(mpack_reader_t* reader) {
+    board_t* board = NULL;
+
+    mpack_expect_array_match(reader, 8);
+
+    board_config_t config;
+    config.width = mpack_expect_u8_range(reader, 1, ROWMASK_WIDTH);
+    config.height = mpack_expect_u8_range(reader, 1, MAX_BOARD_HEIGHT);
+    config.visible_height = mpack_expect_u8_range(reader, 1, config.height);
+    if (mpack_reader_error(reader) != mpack_ok) {
+        error_push("Board configuration is invalid.");
+        goto fail;
+    }
+
+    if ((board = board_new(&config)) == NULL) {
+        goto fail;
+    }
+
+    uint32_t grid_size = mpack_expect_bin_max(reader, MAX_BOARD_GRID_SIZE);
+    const char* grid = mpack_read_bytes_inplace(reader, grid_size);
+    if (mpack_reader_error(reader) != mpack_ok) {
+        error_push("Board grid is missing.");
+        goto fail;
+    }
+    if (board_decode_grid(board, (const uint8_t*)grid, grid_size) == false) {
+        error_push("Board grid is invalid.");
+        goto fail;
+    }
+    mpack_done_bin(reader);
+
+    // Bring the derived state of the board up to date with the grid.
+    board_update_heights(board);
+    board_touch_rows(board, ~(uint64_t)0 >> (MAX_BOARD_HEIGHT - config.height));
+
+    mpack_expect_array_match(reader, MAX_BOARD_PIECES);
+    for (size_t i = 0;i < MAX_BOARD_PIECES;i++) {
+        boardpiece_t* piece = &board->pieces[i];
+        mpack_expect_array_match(reader, 5);
+        piece->handle = mpack_expect_u64(reader);
+        piece->pos.x = mpack_expect_i32(reader);
+        piece->pos.y = mpack_expect_i32(reader);
+        piece->rot = mpack_expect_u8(reader);
+        piece->alpha = mpack_expect_u8(reader);
+        mpack_done_array(reader);
+    }
+    mpack_done_array(reader);
+
+    board->ghost = mpack_expect_u8_max(reader, MAX_BOARD_PIECES);
+    board->ghost_source = mpack_expect_u8_max(reader, MAX_BOARD_PIECES - 1);
+
+    board->garbage_count = mpack_expect_array_max(reader, MAX_BOARD_GARBAGE);
+    for (size_t i = 0;i < board->garbage_count;i++) {
+        board_garbage_t* garbage = &board->garbage[i];
+        mpack_expect_array_match(reader, 3);
+        garbage->ready_tic = mpack_expect_u32(reader);
+        garbage->lines = mpack_expect_u8(reader);
+        garbage->hole = mpack_expect_u8(reader);
+        if (i > 0 && garbage->ready_tic < garbage[-1].ready_tic) {
+            // Attacks are always queued in the order they become ready.
+            mpack_reader_flag_error(reader, mpack_error_data);
+        }
+        mpack_done_array(reader);
+    }
+    mpack_done_array(reader);
+
+    mpack_done_array(reader);
+
+    if (mpack_reader_error(reader) != mpack_ok) {
+        error_push("Board is invalid.");
+        goto fail;
+    }
+
+    return board;
+
+fail:
+    board_delete(board);
+    return NULL;
+}
+
+/**
+ * Wrap serialize with void* function.
+ */
+static void wrapserialize(void* ptr, mpack_writer_t* writer) {
+    board_serialize(ptr, writer);
+}
+
+/**
+ * Wrap delete with void* function.
+ */
+static void wrapdelete(void* ptr) {
+    board_delete(ptr);
+}
+
+/**
+ * Attach a board to an entity.
+ */
+static void board_entity_attach(entity_t* entity, entity_manager_t* manager, board_t* board) {
+    board->manager = manager;
+
+    entity->config.type = MINO_ENTITY_BOARD;
+    entity->config.serialize = wrapserialize;
+    entity->config.destruct = wrapdelete;
+    entity->data = board;
+}
+
+/**
+ * Initialize an entity with random config
+ */
+bool board_entity_init(entity_t* entity, entity_manager_t* manager, const board_config_t* config) {
+    board_t* board = board_new(config);
+    if (board == NULL) {
+        return false;
+    }
+
+    board_entity_attach(entity, manager, board);
+    return true;
+}
+
+/**
+ * Initialize an entity with a serialized board
+ *
+ * The board is attached to the entity manager in the registry, so the
+ * pieces on the board can be looked up again.
+ */
+bool board_entity_unserialize(entity_t* entity, serialize_t* ser, mpack_reader_t* reader) {
+    int top = lua_gettop(ser->lua);
+    board_t* board = NULL;
+
+    // push registry table
+    if (lua_rawgeti(ser->lua, LUA_REGISTRYINDEX, ser->registry_ref) != LUA_TTABLE) {
+        error_push("Registry reference is stale.");
+        goto fail;
+    }
+
+    // push entity manager
+    if (lua_getfield(ser->lua, -1, "entity_manager") != LUA_TLIGHTUSERDATA) {
+        error_push("Entity manager is missing from registry.");
+        goto fail;
+    }
+    entity_manager_t* manager = lua_touserdata(ser->lua, -1);
+
+    if ((board = board_unserialize(reader)) == NULL) {
+        goto fail;
+    }
+
+    board_entity_attach(entity, manager, board);
+
+    lua_settop(ser->lua, top);
+    return true;
+
+fail:
+    lua_settop(ser->lua, top);
+    return false;
 }
@@ -20,16 +20,32 @@
 #include "define.h"
 
 // Forward declarations.
+typedef struct lua_State lua_State;
 typedef struct entity_s entity_t;
 typedef struct entity_manager_s entity_manager_t;
+typedef struct kicks_config_s kicks_config_t;
+typedef struct mpack_reader_t mpack_reader_t;
 typedef struct mpack_writer_t mpack_writer_t;
 typedef struct piece_s piece_t;
 typedef struct piece_config_s piece_config_t;
 typedef struct ruleset_s ruleset_t;
+typedef struct serialize_s serialize_t;
 
 // Maximum number of pieces per board.
 #define MAX_BOARD_PIECES 4
 
+// Maximum height of a board, so a bitmap of its rows fits in a uint64_t.
+#define MAX_BOARD_HEIGHT 64
+
+// Maximum number of positions that can be tested in one batch.
+#define MAX_BOARD_TESTS 32
+
+// Maximum number of pending garbage attacks per board.
+#define MAX_BOARD_GARBAGE 16
+
+// Maximum number of cells a piece can have and still be undone.
+#define MAX_BOARD_UNDO_CELLS 32
+
 typedef struct {
     /**
      * Piece entity handle
@@ -53,6 +69,153 @@ typedef struct {
     uint8_t alpha;
 } boardpiece_t;
 
+/**
+ * A pending garbage attack against a board.
+ */
+typedef struct {
+    /**
+     * Gametic that the garbage can be inserted on.
+     */
+    uint32_t ready_tic;
+
+    /**
+     * Number of garbage lines.
+     */
+    uint8_t lines;
+
+    /**
+     * Column of the hole in every garbage line.
+     */
+    uint8_t hole;
+} board_garbage_t;
+
+/**
+ * A place where a piece can come to rest on the board.
+ */
+typedef struct {
+    /**
+     * Position of the piece.
+     */
+    vec2i_t pos;
+
+    /**
+     * Orientation of the piece.
+     */
+    uint8_t rot;
+} board_placement_t;
+
+/**
+ * A single cell of the board as it was before a piece was locked over it.
+ */
+typedef struct {
+    uint8_t x;
+    uint8_t y;
+    uint8_t value;
+} board_undo_cell_t;
+
+/**
+ * Everything needed to take back a placement on a board.
+ *
+ * Only the cells that the piece was written over and the rows that were
+ * cleared are recorded, so one of these can be reused for any number of
+ * placements without allocating anything.
+ */
+typedef struct {
+    /**
+     * Cells that the piece was locked over, in the order they were written.
+     */
+    board_undo_cell_t cells[MAX_BOARD_UNDO_CELLS];
+
+    /**
+     * Number of recorded cells.
+     */
+    size_t cell_count;
+
+    /**
+     * Bitmap of rows that the piece was locked into.
+     */
+    uint64_t touched;
+
+    /**
+     * Occupancy of every touched row before the piece was locked.
+     */
+    rowmask_t rows[MAX_BOARD_HEIGHT];
+
+    /**
+     * Bitmap of rows that were cleared, where bit n is row n of the board
+     * as it was before the clear.
+     */
+    uint64_t cleared;
+
+    /**
+     * Number of lines that were cleared.
+     */
+    uint8_t lines;
+
+    /**
+     * Contents of every cleared row, from the top down.
+     */
+    uint8_t cleared_data[MAX_BOARD_HEIGHT * ROWMASK_WIDTH];
+
+    /**
+     * Column heights and well depths before the placement.
+     */
+    int16_t heights[ROWMASK_WIDTH];
+    int16_t wells[ROWMASK_WIDTH];
+} board_undo_t;
+
+/**
+ * Features of the stack on a board.
+ */
+typedef struct {
+    /**
+     * Number of empty cells with an occupied cell somewhere above them.
+     */
+    int holes;
+
+    /**
+     * Number of occupied cells with a hole somewhere below them.
+     */
+    int covered;
+
+    /**
+     * Sum of the heights of every column.
+     */
+    int aggregate_height;
+
+    /**
+     * Height of the tallest column.
+     */
+    int max_height;
+
+    /**
+     * Sum of the height differences between neighboring columns.
+     */
+    int bumpiness;
+
+    /**
+     * Number of times a row changes between occupied and empty, reading
+     * from wall to wall.  The walls count as occupied.
+     */
+    int row_transitions;
+
+    /**
+     * Number of times a column changes between occupied and empty, reading
+     * from the top of the board to the floor.  The floor counts as occupied.
+     */
+    int column_transitions;
+
+    /**
+     * Sum of the depths of every well.
+     */
+    int well_sum;
+
+    /**
+     * Depth of the deepest well.
+     */
+    int max_well;
+} board_eval_t;
+
 /**
  * Configuration variables for the board.
  */
@@ -81,8 +244,47 @@ typedef struct {
 
     /**
      * Board data of 'size' length.
+     *
+     * This is the color of every cell, and is only needed for rendering and
+     * for reading individual cells back out.
      */
     uint8_t* data;
+
+    /**
+     * Occupancy of every row of the board, one mask per row.
+     *
+     * This is kept in sync with 'data', and is what collision tests look
+     * at instead of the individual cells.
+     */
+    rowmask_t* rows;
+
+    /**
+     * Row mask with every cell of the row occupied.
+     */
+    rowmask_t full_row;
+
+    /**
+     * Height of the stack in every column, measured from the bottom of the
+     * board to the topmost occupied cell.  An empty column has a height of 0.
+     */
+    int16_t* heights;
+
+    /**
+     * Depth of the well in every column, which is how far the column is below
+     * the lower of its two neighbors.  The walls count as full columns.
+     */
+    int16_t* wells;
+
+    /**
+     * Generation of the board that every row last changed on.
+     */
+    uint32_t* generations;
+
+    /**
+     * Hash of every row of the board, mixed with the row it is on.  An
+     * empty row always hashes to 0.
+     */
+    uint64_t* hashes;
 } board_data_t;
 
 typedef struct board_s {
@@ -121,9 +323,62 @@ typedef struct board_s {
      * Number of active pieces on the board.
      */
     size_t piece_count;
+
+    /**
+     * Index of the piece that is kept as the ghost of another piece, or
+     * MAX_BOARD_PIECES if there is no ghost piece.
+     */
+    size_t ghost;
+
+    /**
+     * Index of the piece that the ghost piece follows.
+     */
+    size_t ghost_source;
+
+    /**
+     * Pending garbage attacks, as a ring buffer in the order they arrived.
+     */
+    board_garbage_t garbage[MAX_BOARD_GARBAGE];
+
+    /**
+     * Index of the oldest pending garbage attack.
+     */
+    size_t garbage_head;
+
+    /**
+     * Number of pending garbage attacks.
+     */
+    size_t garbage_count;
+
+    /**
+     * Bitmap of rows that have changed since the dirty rows were last reset,
+     * where bit n is row n of the board.
+     */
+    uint64_t dirty;
+
+    /**
+     * Counter that goes up every time the contents of the board change.
+     *
+     * Unlike the dirty rows, nobody resets this, so any number of readers
+     * can keep track of what they have seen on their own.
+     */
+    uint32_t generation;
+
+    /**
+     * Hash of the contents of the board.
+     *
+     * This is every row hash XOR'ed together, so it is kept up to date one
+     * row at a time as rows change.  Only the occupancy of the board is
+     * hashed, not the color of the cells.
+     */
+    uint64_t hash;
 } board_t;
 
-board_t* board_new(void);
+board_config_t* board_config_new(lua_State* L);
+void board_config_delete(board_config_t* board_config);
+void board_config_destruct(void* board_config);
+board_t* board_new(const board_config_t* config);
+board_t* board_clone(const board_t* board);
 void board_delete(board_t* board);
 uint8_t board_get(board_t* board, vec2i_t pos);
 handle_t board_get_piece_ref(board_t* board, size_t index);
@@ -131,9 +386,36 @@ bool board_set_piece(board_t* board, size_t index, handle_t handle);
 bool board_unset_piece(board_t* board, size_t index);
 boardpiece_t* board_get_boardpiece(board_t* board, size_t index);
 bool board_test_piece(const board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot);
+bool board_rotate_piece(board_t* board, size_t index, int dir);
+int board_test_positions(const board_t* board, const piece_config_t* piece, vec2i_t pos,
+                         uint8_t rot, const vec2i_t* offsets, size_t count);
 vec2i_t board_test_piece_between(const board_t* board, const piece_config_t* piece,
                                  vec2i_t src, uint8_t rot, vec2i_t dst);
-void board_lock_piece(const board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot);
-uint8_t board_clear_lines(board_t* board);
+int board_get_height(const board_t* board, int x);
+int board_get_well(const board_t* board, int x);
+int board_drop_distance(const board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot);
+board_placement_t* board_find_placements(const board_t* board, const piece_config_t* piece,
+                                         const kicks_config_t* kicks, size_t* count);
+uint64_t board_get_dirty(const board_t* board);
+void board_reset_dirty(board_t* board);
+uint32_t board_get_generation(const board_t* board);
+uint64_t board_get_changed(const board_t* board, uint32_t since);
+uint64_t board_get_hash(const board_t* board);
+void board_evaluate(const board_t* board, board_eval_t* eval);
+int board_count_corners(const board_t* board, size_t index);
+bool board_set_ghost(board_t* board, size_t index, size_t source);
+void board_update_ghost(board_t* board);
+void board_lock_piece(board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot);
+uint8_t board_clear_lines(board_t* board, uint64_t* cleared);
+bool board_apply_placement(board_t* board, const piece_config_t* piece, vec2i_t pos, uint8_t rot,
+                           board_undo_t* undo);
+void board_undo_placement(board_t* board, const board_undo_t* undo);
+bool board_push_garbage(board_t* board, uint8_t lines, uint8_t hole, uint8_t value);
+bool board_queue_garbage(board_t* board, uint8_t lines, uint8_t hole, uint32_t ready_tic);
+uint8_t board_cancel_garbage(board_t* board, uint8_t lines);
+size_t board_get_garbage(const board_t* board);
+size_t board_insert_garbage(board_t* board, uint32_t tic, uint8_t value, bool* overflow);
 void board_serialize(board_t* board, mpack_writer_t* writer);
-bool board_entity_init(entity_t* entity, entity_manager_t* manager);
+board_t* board_unserialize(mpack_reader_t* reader);
+bool board_entity_init(entity_t* entity, entity_manager_t* manager, const board_config_t* config);
+bool board_entity_unserialize(entity_t* entity, serialize_t* ser, mpack_reader_t* reader);
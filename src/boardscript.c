@@ -22,20 +22,22 @@
 #include "board.h"
 #include "entity.h"
 #include "entityscript.h"
+#include "kicks.h"
 #include "proto.h"
+#include "protoscript.h"
 #include "script.h"
 
  /**
   * Lua: Initialize new board state.
   */
 static int boardscript_create(lua_State* L) {
+    // Parameter 1: Board prototype
+    proto_t* proto = protoscript_check_proto(L, 1, MINO_PROTO_BOARD);
+
     // Internal State 1: Entity manager
-    int type = lua_getfield(L, lua_upvalueindex(1), "entity_manager");
-    if (type != LUA_TLIGHTUSERDATA) {
-        luaL_error(L, "missing internal state (entity_manager)");
-        return 0;
-    }
-    entity_manager_t* manager = lua_touserdata(L, -1);
+    entity_manager_t* manager = script_to_context(L)->entities;
+
+    const board_config_t* config = proto->data;
 
     // Allocate the entity
     entity_t* entity = entity_manager_create(manager);
@@ -45,7 +47,7 @@ static int boardscript_create(lua_State* L) {
     }
 
     // Initialize the entity with random state
-    bool ok = board_entity_init(entity, manager);
+    bool ok = board_entity_init(entity, manager, config);
     if (ok == false) {
         luaL_error(L, "could not initialize entity");
         return 0;
@@ -80,6 +82,100 @@ static int boardscript_get(lua_State* L) {
     return 1;
 }
 
+/**
+ * Lua: Get the contents of the board at a position given as x and y
+ */
+static int boardscript_get_xy(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2, 3: Position to check
+    vec2i_t pos = script_check_xy(L, 2);
+
+    // Return board data
+    lua_pushinteger(L, board_get(board, pos));
+    return 1;
+}
+
+/**
+ * Check an optional range of rows passed to a Lua function.
+ *
+ * The range is given as a first and last row, inclusive, and defaults to the
+ * entire board.  Rows are counted from 0 at the top, like positions.
+ */
+static void boardscript_check_rows(lua_State* L, int index, const board_t* board, int* first, int* count) {
+    lua_Integer height = board->config.height;
+
+    lua_Integer start = luaL_optinteger(L, index, 0);
+    luaL_argcheck(L, start >= 0 && start < height, index, "invalid first row");
+
+    lua_Integer end = luaL_optinteger(L, index + 1, height - 1);
+    luaL_argcheck(L, end >= start && end < height, index + 1, "invalid last row");
+
+    *first = (int)start;
+    *count = (int)(end - start + 1);
+}
+
+/**
+ * Lua: Get the contents of a range of rows as a string
+ *
+ * Every cell is one byte, from left to right and then from top to bottom.
+ */
+static int boardscript_dump(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2, 3: First and last row (optional)
+    int first = 0, count = 0;
+    boardscript_check_rows(L, 2, board, &first, &count);
+
+    // Rows are stored one after another, so this is a single copy.
+    int width = board->config.width;
+    lua_pushlstring(L, (const char*)board->data.data + first * width, count * width);
+    return 1;
+}
+
+/**
+ * Lua: Get the occupancy of a range of rows
+ *
+ * Returns an array with an integer for every row, where bit n is set if
+ * column n of that row is occupied.
+ */
+static int boardscript_rows(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2, 3: First and last row (optional)
+    int first = 0, count = 0;
+    boardscript_check_rows(L, 2, board, &first, &count);
+
+    lua_createtable(L, count, 0);
+    for (int i = 0;i < count;i++) {
+        lua_pushinteger(L, (lua_Integer)board->data.rows[first + i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+/**
+ * Lua: Get the dimensions of the board
+ *
+ * Returns the width, height and visible height of the board.
+ */
+static int boardscript_get_size(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    lua_pushinteger(L, board->config.width);
+    lua_pushinteger(L, board->config.height);
+    lua_pushinteger(L, board->config.visible_height);
+    return 3;
+}
+
 /**
  * Lua: Get a board piece handle by index
  */
@@ -179,6 +275,32 @@ static int boardscript_get_pos(lua_State* L) {
     return 1;
 }
 
+/**
+ * Lua: Get piece position as x and y
+ */
+static int boardscript_get_pos_xy(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece index
+    lua_Integer index = luaL_checkinteger(L, 2);
+    if (index <= 0) {
+        luaL_argerror(L, 2, "invalid piece id");
+        return 0;
+    }
+    index -= 1;
+
+    // Get the piece position
+    boardpiece_t* piece = board_get_boardpiece(board, index);
+    if (piece == NULL) {
+        luaL_error(L, "no piece in this board index");
+        return 0;
+    }
+    script_push_xy(L, &piece->pos);
+    return 2;
+}
+
 /**
  * Lua: Set piece position
  */
@@ -210,6 +332,37 @@ static int boardscript_set_pos(lua_State* L) {
         return 0;
     }
     piece->pos = pos;
+    board_update_ghost(board);
+    return 0;
+}
+
+/**
+ * Lua: Set piece position from x and y
+ */
+static int boardscript_set_pos_xy(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece index
+    lua_Integer index = luaL_checkinteger(L, 2);
+    if (index <= 0) {
+        luaL_argerror(L, 2, "invalid piece id");
+        return 0;
+    }
+    index -= 1;
+
+    // Parameter 3, 4: Position
+    vec2i_t pos = script_check_xy(L, 3);
+
+    // Set the piece position
+    boardpiece_t* piece = board_get_boardpiece(board, index);
+    if (piece == NULL) {
+        luaL_error(L, "no piece in this board index");
+        return 0;
+    }
+    piece->pos = pos;
+    board_update_ghost(board);
     return 0;
 }
 
@@ -264,10 +417,46 @@ static int boardscript_set_rot(lua_State* L) {
         luaL_error(L, "no piece in this board index");
         return 0;
     }
+    entity_t* pentity = entity_manager_get(board->manager, piece->handle);
+    if (pentity == NULL || pentity->config.type != MINO_ENTITY_PIECE) {
+        luaL_error(L, "no piece in this board index");
+        return 0;
+    }
+    const piece_config_t* config = ((piece_t*)pentity->data)->config;
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 3, "invalid rotation");
     piece->rot = rot;
+    board_update_ghost(board);
     return 0;
 }
 
+/**
+ * Lua: Rotate a piece on the board, kicking it into place if necessary.
+ */
+static int boardscript_rotate(lua_State* L) {
+    static const char* dirs[] = {
+        "cw", "ccw", NULL
+    };
+
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece index
+    lua_Integer index = luaL_checkinteger(L, 2);
+    if (index <= 0) {
+        luaL_argerror(L, 2, "invalid piece id");
+        return 0;
+    }
+    index -= 1;
+
+    // Parameter 3: Direction of rotation
+    int dir = luaL_checkoption(L, 3, NULL, dirs);
+
+    // Return true if the piece rotated
+    lua_pushboolean(L, board_rotate_piece(board, index, dir));
+    return 1;
+}
+
 /**
  * Lua: Test to see if a piece collides with a specific spot on the board.
  */
@@ -276,8 +465,9 @@ static int boardscript_test_piece(lua_State* L) {
     entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
     board_t* board = entity->data;
 
-    // Parameter 2: Piece name
-    const char* piece_config = luaL_checkstring(L, 2);
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+    piece_config_t* config = proto->data;
 
     // Parameter 3: Position table
     vec2i_t pos = { 0, 0 };
@@ -286,29 +476,87 @@ static int boardscript_test_piece(lua_State* L) {
 
     // Parameter 4: Rotation integer
     lua_Integer rot = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 4, "invalid rotation");
 
-    // Internal State 1: Prototype hash
-    int type = lua_getfield(L, lua_upvalueindex(1), "proto_hash");
-    if (type != LUA_TTABLE) {
-        luaL_error(L, "missing internal state (proto_hash)");
-        return 0;
-    }
+    // Actually run the test and return the result
+    bool result = board_test_piece(board, config, pos, rot);
+    lua_pushboolean(L, result);
+    return 1;
+}
 
-    // Get the piece configuration
-    lua_getfield(L, -1, piece_config);
-    proto_t* proto = lua_touserdata(L, -1);
-    if (proto == NULL || proto->type != MINO_PROTO_PIECE) {
-        luaL_error(L, "invalid piece configuration");
-        return 0;
-    }
+/**
+ * Lua: Test to see if a piece collides with a spot on the board given as
+ *      x and y.
+ */
+static int boardscript_test_piece_xy(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
 
-    // Actually run the test and return the result
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
     piece_config_t* config = proto->data;
+
+    // Parameter 3, 4: Position
+    vec2i_t pos = script_check_xy(L, 3);
+
+    // Parameter 5: Rotation integer
+    lua_Integer rot = luaL_checkinteger(L, 5);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 5, "invalid rotation");
+
+    // Actually run the test and return the result
     bool result = board_test_piece(board, config, pos, rot);
     lua_pushboolean(L, result);
     return 1;
 }
 
+/**
+ * Lua: Test a batch of positions offset from a single position, and return
+ *      the index of the first offset where the piece fits.
+ */
+static int boardscript_test_positions(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+    piece_config_t* config = proto->data;
+
+    // Parameter 3: Position table
+    vec2i_t pos = { 0, 0 };
+    bool ok = script_to_vector(L, 3, &pos);
+    luaL_argcheck(L, ok, 3, "invalid position");
+
+    // Parameter 4: Rotation integer
+    lua_Integer rot = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 4, "invalid rotation");
+
+    // Parameter 5: Flat array of x, y offset pairs
+    luaL_checktype(L, 5, LUA_TTABLE);
+    lua_Integer len = luaL_len(L, 5);
+    luaL_argcheck(L, len % 2 == 0 && len / 2 <= MAX_BOARD_TESTS, 5, "invalid offsets");
+
+    vec2i_t offsets[MAX_BOARD_TESTS];
+    size_t count = (size_t)(len / 2);
+    for (size_t i = 0;i < count;i++) {
+        lua_rawgeti(L, 5, i * 2 + 1);
+        offsets[i].x = (int)lua_tointeger(L, -1);
+        lua_rawgeti(L, 5, i * 2 + 2);
+        offsets[i].y = (int)lua_tointeger(L, -1);
+        lua_pop(L, 2);
+    }
+
+    // Actually run the tests and return the index of the first hit, or nil
+    int result = board_test_positions(board, config, pos, rot, offsets, count);
+    if (result < 0) {
+        lua_pushnil(L);
+    } else {
+        lua_pushinteger(L, result + 1);
+    }
+    return 1;
+}
+
 /**
  * Lua: Repeatedly test collision between two points on a board, and return
  *      the last location where the piece was successfully placed.
@@ -318,8 +566,9 @@ static int boardscript_test_piece_between(lua_State* L) {
     entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
     board_t* board = entity->data;
 
-    // Parameter 2: Piece name
-    const char* piece_config = luaL_checkstring(L, 2);
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+    piece_config_t* config = proto->data;
 
     // Parameter 3: Source position
     vec2i_t src = { 0, 0 };
@@ -328,44 +577,60 @@ static int boardscript_test_piece_between(lua_State* L) {
 
     // Parameter 4: Rotation integer
     lua_Integer rot = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 4, "invalid rotation");
 
     // Parameter 5: Destination position
     vec2i_t dst = { 0, 0 };
     ok = script_to_vector(L, 5, &dst);
     luaL_argcheck(L, ok, 5, "invalid position");
 
-    // Internal State 1: Prototype hash
-    int type = lua_getfield(L, lua_upvalueindex(1), "proto_hash");
-    if (type != LUA_TTABLE) {
-        luaL_error(L, "missing internal state (proto_hash)");
-        return 0;
-    }
-
-    // Get the piece configuration
-    lua_getfield(L, -1, piece_config);
-    proto_t* proto = lua_touserdata(L, -1);
-    if (proto == NULL || proto->type != MINO_PROTO_PIECE) {
-        luaL_error(L, "invalid piece configuration");
-        return 0;
-    }
-
     // Actually run the test and return the result
-    piece_config_t* config = proto->data;
     vec2i_t result = board_test_piece_between(board, config, src, rot, dst);
     script_push_vector(L, &result);
     return 1;
 }
 
 /**
- * Lua: Lock a piece in place on the board.
+ * Lua: Repeatedly test collision between two points on a board given as
+ *      x and y, and return the last location where the piece was
+ *      successfully placed as x and y.
  */
-static int boardscript_lock_piece(lua_State* L) {
+static int boardscript_test_piece_between_xy(lua_State* L) {
     // Parameter 1: Our userdata
     entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
     board_t* board = entity->data;
 
-    // Parameter 2: Piece name
-    const char* piece_config = luaL_checkstring(L, 2);
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+    piece_config_t* config = proto->data;
+
+    // Parameter 3, 4: Source position
+    vec2i_t src = script_check_xy(L, 3);
+
+    // Parameter 5: Rotation integer
+    lua_Integer rot = luaL_checkinteger(L, 5);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 5, "invalid rotation");
+
+    // Parameter 6, 7: Destination position
+    vec2i_t dst = script_check_xy(L, 6);
+
+    // Actually run the test and return the result
+    vec2i_t result = board_test_piece_between(board, config, src, rot, dst);
+    script_push_xy(L, &result);
+    return 2;
+}
+
+/**
+ * Lua: Find how many rows a piece can fall from a position on the board.
+ */
+static int boardscript_drop_distance(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+    piece_config_t* config = proto->data;
 
     // Parameter 3: Position table
     vec2i_t pos = { 0, 0 };
@@ -374,24 +639,236 @@ static int boardscript_lock_piece(lua_State* L) {
 
     // Parameter 4: Rotation integer
     lua_Integer rot = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 4, "invalid rotation");
+
+    // Actually run the query and return the result
+    int distance = board_drop_distance(board, config, pos, rot);
+    lua_pushinteger(L, distance);
+    return 1;
+}
+
+/**
+ * Lua: Find how many rows a piece can fall from a position on the board
+ *      given as x and y.
+ */
+static int boardscript_drop_distance_xy(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+    piece_config_t* config = proto->data;
+
+    // Parameter 3, 4: Position
+    vec2i_t pos = script_check_xy(L, 3);
+
+    // Parameter 5: Rotation integer
+    lua_Integer rot = luaL_checkinteger(L, 5);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 5, "invalid rotation");
+
+    // Actually run the query and return the result
+    int distance = board_drop_distance(board, config, pos, rot);
+    lua_pushinteger(L, distance);
+    return 1;
+}
+
+/**
+ * Push a table of placements found by a search
+ *
+ * Parameter 1 is the placement array, parameter 2 the number of placements.
+ * Every placement becomes a table with a position and rotation.
+ */
+static int boardscript_push_placements(lua_State* L) {
+    const board_placement_t* placements = lua_touserdata(L, 1);
+    lua_Integer count = lua_tointeger(L, 2);
+
+    lua_createtable(L, (int)count, 0);
+    for (lua_Integer i = 0;i < count;i++) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, placements[i].pos.x);
+        lua_setfield(L, -2, "x");
+        lua_pushinteger(L, placements[i].pos.y);
+        lua_setfield(L, -2, "y");
+        lua_pushinteger(L, placements[i].rot);
+        lua_setfield(L, -2, "rot");
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+/**
+ * Lua: Find every place a piece can lock from its spawn position.
+ */
+static int boardscript_find_placements(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+
+    piece_config_t* config = proto->data;
+
+    // Parameter 3: Kicks prototype, optional, defaults to the kicks of the piece
+    const kicks_config_t* kicks = config->kicks;
+    if (!lua_isnoneornil(L, 3)) {
+        proto_t* kicks_proto = protoscript_check_proto(L, 3, MINO_PROTO_KICKS);
+        kicks = kicks_proto->data;
+    }
+
+    // Run the search
+    size_t count = 0;
+    board_placement_t* placements = board_find_placements(board, config, kicks, &count);
+    if (placements == NULL) {
+        luaL_error(L, "could not find placements");
+        return 0;
+    }
+
+    // Building the result can raise an error, so do it in a protected call
+    // and only rethrow once the placements are freed.
+    lua_pushcfunction(L, boardscript_push_placements);
+    lua_pushlightuserdata(L, placements);
+    lua_pushinteger(L, (lua_Integer)count);
+    int res = lua_pcall(L, 2, 1, 0);
+    free(placements);
+    if (res != LUA_OK) {
+        return lua_error(L);
+    }
+    return 1;
+}
+
+/**
+ * Lua: Measure the features of the stack on the board.
+ *
+ * If a piece id is passed, the number of occupied corners around that piece
+ * is measured as well.
+ */
+static int boardscript_evaluate(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece id (optional)
+    int corners = -1;
+    if (!lua_isnoneornil(L, 2)) {
+        lua_Integer index = luaL_checkinteger(L, 2);
+        if (index <= 0 || index > MAX_BOARD_PIECES) {
+            luaL_argerror(L, 2, "invalid piece id");
+            return 0;
+        }
+        corners = board_count_corners(board, index - 1);
+    }
+
+    board_eval_t eval;
+    board_evaluate(board, &eval);
+
+    lua_createtable(L, 0, 10);
+    lua_pushinteger(L, eval.holes);
+    lua_setfield(L, -2, "holes");
+    lua_pushinteger(L, eval.covered);
+    lua_setfield(L, -2, "covered");
+    lua_pushinteger(L, eval.aggregate_height);
+    lua_setfield(L, -2, "aggregate_height");
+    lua_pushinteger(L, eval.max_height);
+    lua_setfield(L, -2, "max_height");
+    lua_pushinteger(L, eval.bumpiness);
+    lua_setfield(L, -2, "bumpiness");
+    lua_pushinteger(L, eval.row_transitions);
+    lua_setfield(L, -2, "row_transitions");
+    lua_pushinteger(L, eval.column_transitions);
+    lua_setfield(L, -2, "column_transitions");
+    lua_pushinteger(L, eval.well_sum);
+    lua_setfield(L, -2, "well_sum");
+    lua_pushinteger(L, eval.max_well);
+    lua_setfield(L, -2, "max_well");
+    if (corners >= 0) {
+        lua_pushinteger(L, corners);
+        lua_setfield(L, -2, "corners");
+    }
+    return 1;
+}
+
+/**
+ * Lua: Make one board piece the ghost of another.
+ */
+static int boardscript_set_ghost(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Ghost piece index, or nil to remove the ghost
+    lua_Integer index = MAX_BOARD_PIECES + 1;
+    if (!lua_isnoneornil(L, 2)) {
+        index = luaL_checkinteger(L, 2);
+        if (index <= 0 || index > MAX_BOARD_PIECES) {
+            luaL_argerror(L, 2, "invalid piece id");
+            return 0;
+        }
+    }
+    index -= 1;
 
-    // Internal State 1: Prototype hash
-    int type = lua_getfield(L, lua_upvalueindex(1), "proto_hash");
-    if (type != LUA_TTABLE) {
-        luaL_error(L, "missing internal state (proto_hash)");
+    // Parameter 3: Source piece index
+    lua_Integer source = luaL_optinteger(L, 3, 1);
+    if (source <= 0 || source > MAX_BOARD_PIECES) {
+        luaL_argerror(L, 3, "invalid piece id");
         return 0;
     }
+    source -= 1;
 
-    // Get the piece configuration
-    lua_getfield(L, -1, piece_config);
-    proto_t* proto = lua_touserdata(L, -1);
-    if (proto == NULL || proto->type != MINO_PROTO_PIECE) {
-        luaL_error(L, "invalid piece configuration");
+    if (board_set_ghost(board, index, source) == false) {
+        luaL_error(L, "could not set ghost piece");
         return 0;
     }
+    return 0;
+}
+
+/**
+ * Lua: Lock a piece in place on the board.
+ */
+static int boardscript_lock_piece(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
+    piece_config_t* config = proto->data;
+
+    // Parameter 3: Position table
+    vec2i_t pos = { 0, 0 };
+    bool ok = script_to_vector(L, 3, &pos);
+    luaL_argcheck(L, ok, 3, "invalid position");
+
+    // Parameter 4: Rotation integer
+    lua_Integer rot = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 4, "invalid rotation");
 
     // Actually lock the piece
+    board_lock_piece(board, config, pos, rot);
+    return 0;
+}
+
+/**
+ * Lua: Lock a piece in place on the board at a position given as x and y.
+ */
+static int boardscript_lock_piece_xy(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 2, MINO_PROTO_PIECE);
     piece_config_t* config = proto->data;
+
+    // Parameter 3, 4: Position
+    vec2i_t pos = script_check_xy(L, 3);
+
+    // Parameter 5: Rotation integer
+    lua_Integer rot = luaL_checkinteger(L, 5);
+    luaL_argcheck(L, rot >= 0 && rot < config->data_count, 5, "invalid rotation");
+
+    // Actually lock the piece
     board_lock_piece(board, config, pos, rot);
     return 0;
 }
@@ -404,9 +881,167 @@ static int boardscript_clear_lines(lua_State* L) {
     entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
     board_t* board = entity->data;
 
-    // Clear lines and return the number of lines cleared.
-    uint8_t lines = board_clear_lines(board);
+    // Clear lines and return the number of lines cleared, along with a
+    // bitmap of which rows were cleared.
+    uint64_t cleared = 0;
+    uint8_t lines = board_clear_lines(board, &cleared);
     lua_pushinteger(L, lines);
+    lua_pushinteger(L, (lua_Integer)cleared);
+    return 2;
+}
+
+/**
+ * Lua: Push rows of garbage into the bottom of the board right away.
+ */
+static int boardscript_push_garbage(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Number of lines
+    lua_Integer lines = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, lines >= 0 && lines <= board->config.height, 2, "invalid number of lines");
+
+    // Parameter 3: Hole column
+    lua_Integer hole = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, hole >= 0 && hole < board->config.width, 3, "invalid hole column");
+
+    // Parameter 4: Garbage block value
+    lua_Integer value = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, value >= 1 && value <= UINT8_MAX, 4, "invalid block value");
+
+    // Returns false if the board overflowed.
+    bool ok = board_push_garbage(board, (uint8_t)lines, (uint8_t)hole, (uint8_t)value);
+    lua_pushboolean(L, ok);
+    return 1;
+}
+
+/**
+ * Lua: Queue up a garbage attack against the board.
+ */
+static int boardscript_queue_garbage(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Number of lines
+    lua_Integer lines = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, lines >= 0 && lines <= UINT8_MAX, 2, "invalid number of lines");
+
+    // Parameter 3: Hole column
+    lua_Integer hole = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, hole >= 0 && hole < board->config.width, 3, "invalid hole column");
+
+    // Parameter 4: Gametic the garbage is ready on
+    lua_Integer ready_tic = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, ready_tic >= 0 && ready_tic <= UINT32_MAX, 4, "invalid gametic");
+
+    // Returns false if the queue is full or the attack is out of order.
+    bool ok = board_queue_garbage(board, (uint8_t)lines, (uint8_t)hole, (uint32_t)ready_tic);
+    lua_pushboolean(L, ok);
+    return 1;
+}
+
+/**
+ * Lua: Cancel pending garbage with an outgoing attack.
+ */
+static int boardscript_cancel_garbage(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Number of lines in the attack
+    lua_Integer lines = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, lines >= 0 && lines <= UINT8_MAX, 2, "invalid number of lines");
+
+    // Return the lines of the attack that are left over.
+    lua_pushinteger(L, board_cancel_garbage(board, (uint8_t)lines));
+    return 1;
+}
+
+/**
+ * Lua: Get the total number of lines of pending garbage.
+ */
+static int boardscript_get_garbage(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    lua_pushinteger(L, (lua_Integer)board_get_garbage(board));
+    return 1;
+}
+
+/**
+ * Lua: Insert all pending garbage that is ready on the given gametic.
+ */
+static int boardscript_insert_garbage(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    // Parameter 2: Current gametic
+    lua_Integer tic = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, tic >= 0 && tic <= UINT32_MAX, 2, "invalid gametic");
+
+    // Parameter 3: Garbage block value
+    lua_Integer value = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, value >= 1 && value <= UINT8_MAX, 3, "invalid block value");
+
+    // Return the number of lines inserted, and false if the board overflowed.
+    bool overflow = false;
+    size_t lines = board_insert_garbage(board, (uint32_t)tic, (uint8_t)value, &overflow);
+    lua_pushinteger(L, (lua_Integer)lines);
+    lua_pushboolean(L, !overflow);
+    return 2;
+}
+
+/**
+ * Lua: Get the rows that have changed since the dirty rows were last reset.
+ */
+static int boardscript_get_dirty(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    lua_pushinteger(L, (lua_Integer)board_get_dirty(board));
+    return 1;
+}
+
+/**
+ * Lua: Forget about any rows that have changed.
+ */
+static int boardscript_reset_dirty(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    board_reset_dirty(board);
+    return 0;
+}
+
+/**
+ * Lua: Get the current generation of the board.
+ */
+static int boardscript_get_generation(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    lua_pushinteger(L, board_get_generation(board));
+    return 1;
+}
+
+/**
+ * Lua: Get the hash of the contents of the board.
+ *
+ * The hash is returned as an integer, which may be negative.
+ */
+static int boardscript_get_hash(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+    board_t* board = entity->data;
+
+    lua_pushinteger(L, (lua_Integer)board_get_hash(board));
     return 1;
 }
 
@@ -414,17 +1049,42 @@ int boardscript_openlib(lua_State* L) {
     static const luaL_Reg boardlib[] = {
         { "create", boardscript_create },
         { "get", boardscript_get },
+        { "get_xy", boardscript_get_xy },
+        { "dump", boardscript_dump },
+        { "rows", boardscript_rows },
+        { "get_size", boardscript_get_size },
         { "get_piece", boardscript_get_piece },
         { "set_piece", boardscript_set_piece },
         { "unset_piece", boardscript_unset_piece },
         { "get_pos", boardscript_get_pos },
+        { "get_pos_xy", boardscript_get_pos_xy },
         { "set_pos", boardscript_set_pos },
+        { "set_pos_xy", boardscript_set_pos_xy },
         { "get_rot", boardscript_get_rot },
         { "set_rot", boardscript_set_rot },
+        { "rotate", boardscript_rotate },
         { "test_piece", boardscript_test_piece },
+        { "test_piece_xy", boardscript_test_piece_xy },
+        { "test_positions", boardscript_test_positions },
         { "test_piece_between", boardscript_test_piece_between },
+        { "test_piece_between_xy", boardscript_test_piece_between_xy },
+        { "drop_distance", boardscript_drop_distance },
+        { "drop_distance_xy", boardscript_drop_distance_xy },
+        { "find_placements", boardscript_find_placements },
+        { "evaluate", boardscript_evaluate },
+        { "set_ghost", boardscript_set_ghost },
         { "lock_piece", boardscript_lock_piece },
+        { "lock_piece_xy", boardscript_lock_piece_xy },
         { "clear_lines", boardscript_clear_lines },
+        { "push_garbage", boardscript_push_garbage },
+        { "queue_garbage", boardscript_queue_garbage },
+        { "cancel_garbage", boardscript_cancel_garbage },
+        { "get_garbage", boardscript_get_garbage },
+        { "insert_garbage", boardscript_insert_garbage },
+        { "get_dirty", boardscript_get_dirty },
+        { "reset_dirty", boardscript_reset_dirty },
+        { "get_generation", boardscript_get_generation },
+        { "get_hash", boardscript_get_hash },
         { NULL, NULL }
     };
 
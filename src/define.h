@@ -108,6 +108,50 @@ static inline vec2i_t vec2i_zero(void) {
     return zero;
 }
 
+/**
+ * Bitmask of a single row of cells.  Bit 0 is the leftmost cell.
+ */
+typedef uint64_t rowmask_t;
+
+/**
+ * Number of cells that can be represented by a single row mask.
+ */
+#define ROWMASK_WIDTH 64
+
+/**
+ * Return the index of the lowest set bit of a row mask.
+ *
+ * The mask must not be empty.
+ */
+static inline int rowmask_ctz(rowmask_t mask) {
+#ifdef __GNUC__
+    return __builtin_ctzll(mask);
+#else
+    int i = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        i += 1;
+    }
+    return i;
+#endif
+}
+
+/**
+ * Return the number of set bits in a row mask.
+ */
+static inline int rowmask_popcount(rowmask_t mask) {
+#ifdef __GNUC__
+    return __builtin_popcountll(mask);
+#else
+    int count = 0;
+    while (mask != 0) {
+        mask &= mask - 1;
+        count += 1;
+    }
+    return count;
+#endif
+}
+
 /**
  * Generic buffer of bytes.
  */
@@ -28,6 +28,191 @@
 
 KHASH_MAP_INIT_INT64(entities, entity_t*);
 
+// Let AddressSanitizer catch use of pooled blocks after they are freed, the
+// same as it would if they came from malloc.
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) && !defined(__SANITIZE_ADDRESS__)
+#define __SANITIZE_ADDRESS__ 1
+#endif
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define ENTITY_POOL_POISON(ptr, size) ASAN_POISON_MEMORY_REGION(ptr, size)
+#define ENTITY_POOL_UNPOISON(ptr, size) ASAN_UNPOISON_MEMORY_REGION(ptr, size)
+#else
+#define ENTITY_POOL_POISON(ptr, size) ((void)(ptr), (void)(size))
+#define ENTITY_POOL_UNPOISON(ptr, size) ((void)(ptr), (void)(size))
+#endif
+
+/**
+ * Number of blocks carved out of every slab of an entity pool.
+ */
+#define ENTITY_POOL_SLAB_BLOCKS 64
+
+/**
+ * Every block in a pool is rounded up to a multiple of this many bytes,
+ * which is also the alignment of every block.
+ */
+#define ENTITY_POOL_ALIGN 16
+
+/**
+ * A freed block, waiting to be handed out again.
+ */
+typedef struct entity_pool_free_s {
+    struct entity_pool_free_s* next;
+} entity_pool_free_t;
+
+/**
+ * Header of a slab.  Blocks are carved out of the space after it.
+ */
+typedef union entity_pool_slab_u {
+    union entity_pool_slab_u* next;
+    uint8_t align[ENTITY_POOL_ALIGN];
+} entity_pool_slab_t;
+
+/**
+ * Pool of same-sized blocks, carved out of slabs and recycled through a
+ * free list.
+ */
+typedef struct {
+    entity_pool_stats_t stats;
+
+    /**
+     * Blocks that are ready to be handed out.
+     */
+    entity_pool_free_t* free;
+
+    /**
+     * Every slab of the pool.
+     */
+    entity_pool_slab_t* slabs;
+} entity_pool_t;
+
+/**
+ * Pools of every type of entity.  Entities themselves come out of the
+ * MINO_ENTITY_NONE pool, and their payloads out of the pool of their type.
+ *
+ * Destructors only get the payload, so the pools can't belong to an entity
+ * manager.
+ */
+static entity_pool_t g_entity_pools[MINO_ENTITY_MAX];
+
+/**
+ * Add a slab worth of blocks to the free list of a pool
+ */
+static bool entity_pool_grow(entity_pool_t* pool) {
+    entity_pool_slab_t* slab = malloc(sizeof(entity_pool_slab_t) +
+                                      pool->stats.size * ENTITY_POOL_SLAB_BLOCKS);
+    if (slab == NULL) {
+        return false;
+    }
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    // Thread the blocks onto the free list back to front, so they're handed
+    // out in address order.
+    uint8_t* blocks = (uint8_t*)(slab + 1);
+    for (size_t i = ENTITY_POOL_SLAB_BLOCKS;i > 0;i--) {
+        entity_pool_free_t* block = (entity_pool_free_t*)(blocks + (i - 1) * pool->stats.size);
+        block->next = pool->free;
+        pool->free = block;
+        ENTITY_POOL_POISON(block, pool->stats.size);
+    }
+
+    pool->stats.capacity += ENTITY_POOL_SLAB_BLOCKS;
+    pool->stats.slabs += 1;
+    return true;
+}
+
+/**
+ * Allocate a zeroed block for an entity or its payload
+ *
+ * Every allocation from the pool of a type must be the same size, which is
+ * fixed by the first one.  Once a pool has warmed up, this only pops a free
+ * list.
+ */
+void* entity_pool_alloc(entity_type_t type, size_t size) {
+    if (type >= MINO_ENTITY_MAX) {
+        error_push("Unknown entity type (%u)", (unsigned)type);
+        return NULL;
+    }
+
+    entity_pool_t* pool = &g_entity_pools[type];
+    if (pool->stats.size == 0) {
+        pool->stats.size = (size + ENTITY_POOL_ALIGN - 1) & ~(size_t)(ENTITY_POOL_ALIGN - 1);
+        if (pool->stats.size == 0) {
+            pool->stats.size = ENTITY_POOL_ALIGN;
+        }
+    } else if (size > pool->stats.size) {
+        error_push("Entity pool block is too small (%zu > %zu)", size, pool->stats.size);
+        return NULL;
+    }
+
+    if (pool->free == NULL && entity_pool_grow(pool) == false) {
+        error_push_allocerr();
+        return NULL;
+    }
+
+    entity_pool_free_t* block = pool->free;
+    ENTITY_POOL_UNPOISON(block, pool->stats.size);
+    pool->free = block->next;
+    pool->stats.used += 1;
+
+    memset(block, 0x00, pool->stats.size);
+    return block;
+}
+
+/**
+ * Give a block back to the pool of its type
+ */
+void entity_pool_free(entity_type_t type, void* ptr) {
+    if (ptr == NULL || type >= MINO_ENTITY_MAX) {
+        return;
+    }
+
+    entity_pool_t* pool = &g_entity_pools[type];
+    entity_pool_free_t* block = ptr;
+    block->next = pool->free;
+    pool->free = block;
+    pool->stats.used -= 1;
+    ENTITY_POOL_POISON(block, pool->stats.size);
+}
+
+/**
+ * Free the slabs of every pool
+ *
+ * Every block must have been given back first.  Run at shutdown, so that
+ * leak checkers don't report the slabs.
+ */
+void entity_pools_free(void) {
+    for (size_t i = 0;i < MINO_ENTITY_MAX;i++) {
+        entity_pool_t* pool = &g_entity_pools[i];
+        entity_pool_slab_t* slab = pool->slabs;
+        while (slab != NULL) {
+            entity_pool_slab_t* next = slab->next;
+            ENTITY_POOL_UNPOISON(slab + 1, pool->stats.size * ENTITY_POOL_SLAB_BLOCKS);
+            free(slab);
+            slab = next;
+        }
+
+        memset(pool, 0x00, sizeof(*pool));
+    }
+}
+
+/**
+ * Get the occupancy of the pool of a type
+ */
+void entity_pool_get_stats(entity_type_t type, entity_pool_stats_t* stats) {
+    if (type >= MINO_ENTITY_MAX) {
+        memset(stats, 0x00, sizeof(*stats));
+        return;
+    }
+
+    *stats = g_entity_pools[type].stats;
+}
+
 /**
  * Entity manager instance
  */
@@ -92,9 +277,8 @@ extern random_t* random_unserialize(serialize_t* ser, mpack_reader_t* reader);
 typedef struct piece_s piece_t;
 extern void piece_entity_init(entity_t* entity);
 extern piece_t* piece_unserialize(serialize_t* ser, mpack_reader_t* reader);
-typedef struct board_s board_t;
-extern void board_entity_init(entity_t* entity);
-extern board_t* board_unserialize(serialize_t* ser, mpack_reader_t* reader);
+extern bool board_entity_unserialize(entity_t* entity, serialize_t* ser, mpack_reader_t* reader);
+extern bool rules_entity_unserialize(entity_t* entity, serialize_t* ser, mpack_reader_t* reader);
 
 /**
  * Unserialize to an entity
@@ -125,9 +309,18 @@ bool entity_unserialize(entity_t* entity, serialize_t* ser, const buffer_t* buff
         entity->data = piece_unserialize(ser, &reader);
         break;
     case MINO_ENTITY_BOARD:
-        board_entity_init(entity);
+        if (board_entity_unserialize(entity, ser, &reader) == false) {
+            mpack_reader_destroy(&reader);
+            return false;
+        }
+        entity->id = id;
+        break;
+    case MINO_ENTITY_RULES:
+        if (rules_entity_unserialize(entity, ser, &reader) == false) {
+            mpack_reader_destroy(&reader);
+            return false;
+        }
         entity->id = id;
-        entity->data = board_unserialize(ser, &reader);
         break;
     default:
         error_push("Unknown entity ID (%u)", type);
@@ -204,7 +397,7 @@ void entity_manager_delete(entity_manager_t* manager) {
         if (kh_exist(manager->entities, it) == 1) {
             entity_t* entity = kh_val(manager->entities, it);
             entity_deinit(entity);
-            free(entity);
+            entity_pool_free(MINO_ENTITY_NONE, entity);
             entity = NULL;
         }
     }
@@ -221,9 +414,8 @@ void entity_manager_delete(entity_manager_t* manager) {
 entity_t* entity_manager_create(entity_manager_t* manager) {
     entity_t* entity = NULL;
 
-    entity = calloc(1, sizeof(*entity));
+    entity = entity_pool_alloc(MINO_ENTITY_NONE, sizeof(*entity));
     if (entity == NULL) {
-        error_push_allocerr();
         goto fail;
     }
 
@@ -248,7 +440,7 @@ entity_t* entity_manager_create(entity_manager_t* manager) {
 
 fail:
     entity_deinit(entity);
-    free(entity);
+    entity_pool_free(MINO_ENTITY_NONE, entity);
     return NULL;
 }
 
@@ -270,13 +462,17 @@ entity_t* entity_manager_get(entity_manager_t* manager, handle_t id) {
  */
 void entity_manager_destroy(entity_manager_t* manager, handle_t id) {
     // Find the entity
-    entity_t* entity = entity_manager_get(manager, id);
+    khint_t it = kh_get(entities, manager->entities, id);
+    if (it == kh_end(manager->entities)) {
+        return;
+    }
+    entity_t* entity = kh_val(manager->entities, it);
 
-    // Delete the entity - NULL entities are ignored
+    // Delete the entity
     entity_deinit(entity);
-    free(entity);
+    entity_pool_free(MINO_ENTITY_NONE, entity);
     entity = NULL;
 
     // Delete the hashtable entry
-    kh_del(entities, manager->entities, id);
+    kh_del(entities, manager->entities, it);
 }
@@ -32,6 +32,8 @@ typedef enum {
     MINO_ENTITY_RANDOM,
     MINO_ENTITY_PIECE,
     MINO_ENTITY_BOARD,
+    MINO_ENTITY_RULES,
+    MINO_ENTITY_MAX,
     MINO_ENTITY_ANY = 0
 } entity_type_t;
 
@@ -85,6 +87,36 @@ typedef struct entity_s {
     void* data;
 } entity_t;
 
+/**
+ * Occupancy of the pool that entities of one type are allocated from.
+ */
+typedef struct {
+    /**
+     * Size of every block in the pool, or 0 if nothing has been allocated
+     * from it yet.
+     */
+    size_t size;
+
+    /**
+     * Number of blocks currently handed out.
+     */
+    size_t used;
+
+    /**
+     * Number of blocks carved out of slabs, handed out or not.
+     */
+    size_t capacity;
+
+    /**
+     * Number of slabs allocated.
+     */
+    size_t slabs;
+} entity_pool_stats_t;
+
+void* entity_pool_alloc(entity_type_t type, size_t size);
+void entity_pool_free(entity_type_t type, void* ptr);
+void entity_pool_get_stats(entity_type_t type, entity_pool_stats_t* stats);
+void entity_pools_free(void);
 buffer_t* entity_serialize(entity_t* entity);
 bool entity_unserialize(entity_t* entity, serialize_t* ser, const buffer_t* buffer);
 void entity_deinit(entity_t* entity);
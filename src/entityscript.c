@@ -19,6 +19,8 @@
 
 #include "lauxlib.h"
 
+#include "script.h"
+
 /**
  * Lua: Destroy an entity
  */
@@ -49,15 +51,8 @@ int entityscript_openlib(lua_State* L) {
  * Convert the handle at the given index to an entity
  */
 entity_t* entityscript_to_entity(lua_State* L, int handle_index, entity_type_t expected_type) {
-    int top = lua_gettop(L);
-
     // Internal State: Entity manager
-    int type = lua_getfield(L, lua_upvalueindex(1), "entity_manager");
-    if (type != LUA_TLIGHTUSERDATA) {
-        luaL_error(L, "missing internal state (entity_manager)");
-        return 0;
-    }
-    entity_manager_t* manager = lua_touserdata(L, -1);
+    entity_manager_t* manager = script_to_context(L)->entities;
 
     // Parameter: Our handle
     handle_t* id = luaL_checkudata(L, handle_index, "handle_t");
@@ -70,6 +65,5 @@ entity_t* entityscript_to_entity(lua_State* L, int handle_index, entity_type_t e
         return NULL;
     }
 
-    lua_settop(L, top);
     return entity;
 }
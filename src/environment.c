@@ -18,6 +18,7 @@
 #include "environment.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "lauxlib.h"
 
@@ -26,8 +27,21 @@
 #include "inputscript.h"
 #include "proto.h"
 #include "script.h"
+#include "scriptprof.h"
 #include "serialize.h"
 
+/**
+ * Most frames that can run without the garbage collector being given any
+ * time, before the environment gives it time itself.
+ */
+#define ENVIRONMENT_GC_FRAMES 60
+
+/**
+ * Milliseconds that the environment gives the garbage collector when it
+ * has to collect by itself.
+ */
+#define ENVIRONMENT_GC_BUDGET 1.0
+
 static lua_State *getthread (lua_State *L, int *arg) {
     if (lua_isthread(L, 1)) {
         *arg = 1;
@@ -55,6 +69,99 @@ static int db_traceback(lua_State *L) {
     return 1;
 }
 
+/**
+ * Charge anything that Lua allocates from here on to the environment
+ *
+ * The garbage collector is also stopped, so the environment never has to
+ * wait on a collection in the middle of a frame.  The frontend gives the
+ * collector whatever time is left over at the end of the frame instead,
+ * and environment_backstop makes sure it gets time even if the frontend
+ * never has any left over.
+ * If the environment is being profiled, sampling starts here too.
+ *
+ * Returns the account to hand back to environment_leave.
+ */
+static uint32_t environment_enter(environment_t* env) {
+    env->collecting = script_gc_stop(env->lua);
+    if (env->profiler != NULL) {
+        scriptprof_start(env->profiler);
+    }
+
+    if (env->alloc == NULL) {
+        return SCRIPTALLOC_STATE_ACCOUNT;
+    }
+
+    return scriptalloc_switch_account(env->alloc, env->memory);
+}
+
+/**
+ * Go back to charging allocations to whoever was charged before, stop any
+ * profiling, and let the garbage collector run again
+ */
+static void environment_leave(environment_t* env, uint32_t previous) {
+    if (env->alloc != NULL) {
+        scriptalloc_switch_account(env->alloc, previous);
+    }
+
+    if (env->profiler != NULL) {
+        scriptprof_stop(env->profiler);
+    }
+    script_gc_restart(env->lua, env->collecting);
+}
+
+/**
+ * Collect garbage by ourselves if nobody else has for too long
+ *
+ * Run after every frame.  If the collection schedule hasn't moved for too
+ * many frames, or the heap has grown to twice the size that should have
+ * started a cycle, the collector is given a step.  That way headless
+ * callers that never collect, and frontends that keep running out of
+ * time, don't grow the heap without bound.
+ */
+static void environment_backstop(environment_t* env) {
+    script_gc_t* gc = script_get_gc(env->lua);
+    if (gc->collections != env->gc_collections) {
+        env->gc_collections = gc->collections;
+        env->gc_frames = 0;
+        return;
+    }
+
+    env->gc_frames += 1;
+    int heap = lua_gc(env->lua, LUA_GCCOUNT, 0);
+    bool overgrown = gc->threshold > 0 && heap >= gc->threshold * 2;
+    if (env->gc_frames < ENVIRONMENT_GC_FRAMES && overgrown == false) {
+        return;
+    }
+
+    script_gc_step(env->lua, gc, ENVIRONMENT_GC_BUDGET);
+    env->gc_collections = gc->collections;
+    env->gc_frames = 0;
+}
+
+/**
+ * Size that a saved state is charged to the memory account as
+ */
+static size_t environment_state_size(const buffer_t* serialized) {
+    return sizeof(*serialized) + serialized->size;
+}
+
+/**
+ * Free the serialized state of a portable state, crediting the memory
+ * account of the environment
+ */
+static void environment_free_state(environment_t* env, portstate_t* state) {
+    if (state->serialized == NULL) {
+        return;
+    }
+
+    if (env->alloc != NULL) {
+        scriptalloc_credit_block(env->alloc, env->memory,
+                                 environment_state_size(state->serialized));
+    }
+    buffer_delete(state->serialized);
+    state->serialized = NULL;
+}
+
 /**
  * Create a environment that our game scripts can run inside
  */
@@ -62,6 +169,7 @@ environment_t* environment_new(lua_State* L, const char* ruleset, const char* ga
     environment_t* env = NULL;
     proto_container_t* protos = NULL;
     entity_manager_t* entities = NULL;
+    uint32_t previous = SCRIPTALLOC_STATE_ACCOUNT;
 
     int top = lua_gettop(L);
 
@@ -84,19 +192,37 @@ environment_t* environment_new(lua_State* L, const char* ruleset, const char* ga
     }
 
     env->lua = L;
+    env->alloc = scriptalloc_from_state(L);
+    env->memory = SCRIPTALLOC_STATE_ACCOUNT;
     env->registry_ref = LUA_NOREF;
     env->env_ref = LUA_NOREF;
     env->ruleset_ref = LUA_NOREF;
     env->state_ref = LUA_NOREF;
+    env->start_ref = LUA_NOREF;
+    env->frame_ref = LUA_NOREF;
+    env->draw_ref = LUA_NOREF;
+    env->inputs_ref = LUA_NOREF;
     env->gametic = 0;
     env->protos = protos;
     env->entities = entities;
+    env->context.entities = entities;
+    env->context.protos = protos;
     for (size_t i = 0;i < ARRAY_LEN(env->states);i++) {
         env->states[i].serialized = NULL;
         env->states[i].entity_next = 0;
         env->states[i].gametic = 0;
     }
 
+    // Everything that Lua allocates for the environment is charged to an
+    // account of its own.
+    if (env->alloc != NULL) {
+        env->memory = scriptalloc_open_account(env->alloc, 0);
+        if (env->memory == SCRIPTALLOC_STATE_ACCOUNT) {
+            goto fail;
+        }
+    }
+    previous = environment_enter(env);
+
     // Create an environment-specific registry table and push a ref to it
     // into the global registry.
     lua_newtable(L);
@@ -119,6 +245,8 @@ environment_t* environment_new(lua_State* L, const char* ruleset, const char* ga
     lua_setfield(L, -2, "proto_container");
     lua_pushlightuserdata(L, env->entities);
     lua_setfield(L, -2, "entity_manager");
+    lua_pushlightuserdata(L, &env->context);
+    lua_setfield(L, -2, "context");
     lua_newtable(L); // prototype lookup table
     lua_setfield(L, -2, "proto_hash");
     lua_pushinteger(L, 1); // next entity id
@@ -140,7 +268,7 @@ environment_t* environment_new(lua_State* L, const char* ruleset, const char* ga
     // For our new environment, set up links to the proper modules and globals.
     const char* modules[] = {
         "math", "mino_audio", "mino_board", "mino_input", "mino_piece",
-        "mino_proto", "mino_random", "mino_render", "string", "table"
+        "mino_proto", "mino_random", "mino_render", "mino_rules", "string", "table"
     };
     lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
     for (size_t i = 0;i < ARRAY_LEN(modules);i++) {
@@ -168,12 +296,34 @@ environment_t* environment_new(lua_State* L, const char* ruleset, const char* ga
         goto fail;
     }
 
+    // Keep a reference to the functions of the ruleset module that we call
+    // every tic.  Missing functions are reported when they're called.
+    if (lua_type(L, -1) == LUA_TTABLE) {
+        int* refs[] = { &env->start_ref, &env->frame_ref, &env->draw_ref };
+        const char* names[] = { "start", "frame", "draw" };
+        for (size_t i = 0;i < ARRAY_LEN(refs);i++) {
+            if (lua_getfield(L, -1, names[i]) == LUA_TFUNCTION) {
+                *refs[i] = luaL_ref(L, LUA_REGISTRYINDEX); // pop function
+            } else {
+                lua_pop(L, 1); // pop non-function
+            }
+        }
+    }
+
     // Keep a reference to our ruleset module table.
     if ((env->ruleset_ref = luaL_ref(L, LUA_REGISTRYINDEX)) == LUA_REFNIL) { // pop ruleset table
         error_push_allocerr();
         goto fail;
     }
 
+    // One inputs userdata is handed to every frame, so we don't allocate a
+    // new one every tic.
+    env->inputs = inputscript_push_new_inputs(L);
+    if ((env->inputs_ref = luaL_ref(L, LUA_REGISTRYINDEX)) == LUA_REFNIL) { // pop inputs
+        error_push_allocerr();
+        goto fail;
+    }
+
     // Always finish your Lua meddling with a clean stack.
     lua_pop(L, 2);
     if (lua_gettop(L) != top) {
@@ -181,9 +331,13 @@ environment_t* environment_new(lua_State* L, const char* ruleset, const char* ga
         goto fail;
     }
 
+    environment_leave(env, previous);
     return env;
 
 fail:
+    if (env != NULL) {
+        environment_leave(env, previous);
+    }
     environment_delete(env);
     return NULL;
 }
@@ -198,18 +352,27 @@ void environment_delete(environment_t* env) {
 
     for (size_t i = 0;i < ARRAY_LEN(env->states);i++) {
         if (env->states[i].serialized != NULL) {
-            buffer_delete(env->states[i].serialized);
-            env->states[i].serialized = NULL;
+            environment_free_state(env, &env->states[i]);
             env->states[i].entity_next = 0;
             env->states[i].gametic = 0;
         }
     }
 
+    luaL_unref(env->lua, LUA_REGISTRYINDEX, env->inputs_ref);
     luaL_unref(env->lua, LUA_REGISTRYINDEX, env->state_ref);
+    luaL_unref(env->lua, LUA_REGISTRYINDEX, env->draw_ref);
+    luaL_unref(env->lua, LUA_REGISTRYINDEX, env->frame_ref);
+    luaL_unref(env->lua, LUA_REGISTRYINDEX, env->start_ref);
     luaL_unref(env->lua, LUA_REGISTRYINDEX, env->ruleset_ref);
     luaL_unref(env->lua, LUA_REGISTRYINDEX, env->env_ref);
     luaL_unref(env->lua, LUA_REGISTRYINDEX, env->registry_ref);
 
+    // Whatever the environment leaves behind for the garbage collector
+    // isn't charged to anybody.
+    if (env->alloc != NULL) {
+        scriptalloc_close_account(env->alloc, env->memory);
+    }
+
     proto_container_delete(env->protos);
     env->protos = NULL;
 
@@ -227,6 +390,7 @@ void environment_delete(environment_t* env) {
  */
 bool environment_dostring(environment_t* env, const char* script) {
     int top = lua_gettop(env->lua);
+    uint32_t previous = environment_enter(env);
 
     // Load the string into a chunk
     if (luaL_loadstring(env->lua, script) != LUA_OK) {
@@ -247,10 +411,12 @@ bool environment_dostring(environment_t* env, const char* script) {
         goto fail;
     }
 
+    environment_leave(env, previous);
     return true;
 
 fail:
     lua_settop(env->lua, top);
+    environment_leave(env, previous);
     return false;
 }
 
@@ -262,12 +428,14 @@ fail:
  */
 bool environment_start(environment_t* env) {
     int top = lua_gettop(env->lua);
+    uint32_t previous = environment_enter(env);
 
     // Error message handler
     lua_pushcfunction(env->lua, db_traceback);
 
     // Gametic must be zero, in case of restart.
     env->gametic = 0;
+    memset(env->inputs, 0, sizeof(*env->inputs));
 
     // Garbage-collect any existing state table we have.
     luaL_unref(env->lua, LUA_REGISTRYINDEX, env->state_ref);
@@ -280,12 +448,7 @@ bool environment_start(environment_t* env) {
    }
 
     // Try and call a function called "start" to initialize the game.
-    if (lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->ruleset_ref) != LUA_TTABLE) {
-        error_push("Ruleset module reference has gone stale.");
-        goto fail;
-    }
-
-    if (lua_getfield(env->lua, -1, "start") != LUA_TFUNCTION) {
+    if (lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->start_ref) != LUA_TFUNCTION) {
         error_push("Ruleset module has no start function.");
         goto fail;
     }
@@ -304,10 +467,12 @@ bool environment_start(environment_t* env) {
     environment_save(env);
 
     lua_settop(env->lua, top);
+    environment_leave(env, previous);
     return true;
 
 fail:
     lua_settop(env->lua, top);
+    environment_leave(env, previous);
     return false;
 }
 
@@ -343,10 +508,22 @@ bool environment_save(environment_t* env) {
         goto fail;
     }
 
+    // Saved states are kept on behalf of the environment, so they count
+    // against its memory as well.
+    if (env->alloc != NULL &&
+        scriptalloc_charge_block(env->alloc, env->memory,
+                                 environment_state_size(serialized)) == false) {
+        error_push("State is over the memory limit of the environment.");
+        buffer_delete(serialized);
+        goto fail;
+    }
+
     // Now we have everything we need.  Write it.
+    environment_free_state(env, &env->states[0]);
     env->states[0].serialized = serialized;
     env->states[0].entity_next = entity_next;
     env->states[0].gametic = env->gametic;
+    env->states[0].inputs = env->inputs->current;
 
     lua_settop(env->lua, top);
     return true;
@@ -363,9 +540,13 @@ bool environment_rewind(environment_t* env, uint32_t frame) {
     (void)frame;
     int top = lua_gettop(env->lua);
 
+    // The restored state is charged to the environment, like the original.
+    uint32_t previous = environment_enter(env);
     serialize_t ser = { env->lua, env->registry_ref };
     serialize_push_serialized(&ser, env->states[0].serialized);
     env->gametic = env->states[0].gametic;
+    env->inputs->current = env->states[0].inputs;
+    environment_leave(env, previous);
 
     return true;
 }
@@ -375,17 +556,13 @@ bool environment_rewind(environment_t* env, uint32_t frame) {
  */
 bool environment_frame(environment_t* env, const playerinputs_t* inputs) {
     int top = lua_gettop(env->lua);
+    uint32_t previous = environment_enter(env);
 
     // Error message handler
     lua_pushcfunction(env->lua, db_traceback);
 
     // Try and call a function called "frame" to advance the game.
-    if (lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->ruleset_ref) != LUA_TTABLE) {
-        error_push("Ruleset module reference has gone stale.");
-        goto fail;
-    }
-
-    if (lua_getfield(env->lua, -1, "frame") != LUA_TFUNCTION) {
+    if (lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->frame_ref) != LUA_TFUNCTION) {
         error_push("Ruleset module has no frame function.");
         goto fail;
     }
@@ -401,7 +578,11 @@ bool environment_frame(environment_t* env, const playerinputs_t* inputs) {
     lua_pushinteger(env->lua, gametic);
 
     // Parameter 3: Player inputs
-    inputscript_push_inputs(env->lua, inputs);
+    inputscript_update_inputs(env->inputs, inputs);
+    if (lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->inputs_ref) != LUA_TUSERDATA) {
+        error_push("Inputs reference has gone stale.");
+        goto fail;
+    }
 
     if (lua_pcall(env->lua, 3, 1, top + 1) != LUA_OK) {
         error_push("Lua error: %s", lua_tostring(env->lua, -1));
@@ -414,14 +595,19 @@ bool environment_frame(environment_t* env, const playerinputs_t* inputs) {
     // Result: If false, then the game should be shut down nicely
     if (lua_toboolean(env->lua, -1) == 0) {
         lua_settop(env->lua, top);
+        environment_leave(env, previous);
+        environment_backstop(env);
         return false;
     }
 
     lua_settop(env->lua, top);
+    environment_leave(env, previous);
+    environment_backstop(env);
     return true;
 
 fail:
     lua_settop(env->lua, top);
+    environment_leave(env, previous);
     return false;
 }
 
@@ -430,17 +616,13 @@ fail:
  */
 void environment_draw(environment_t* env) {
     int top = lua_gettop(env->lua);
+    uint32_t previous = environment_enter(env);
 
     // Error message handler
     lua_pushcfunction(env->lua, db_traceback);
 
     // Try and call a function called "draw" to draw the game.
-    if (lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->ruleset_ref) != LUA_TTABLE) {
-        error_push("Ruleset module reference has gone stale.");
-        goto fail;
-    }
-
-    if (lua_getfield(env->lua, -1, "draw") != LUA_TFUNCTION) {
+    if (lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->draw_ref) != LUA_TFUNCTION) {
         error_push("Ruleset module has no draw function.");
         goto fail;
     }
@@ -461,8 +643,42 @@ void environment_draw(environment_t* env) {
     }
 
     lua_settop(env->lua, top);
+    environment_leave(env, previous);
     return;
 
 fail:
     lua_settop(env->lua, top);
+    environment_leave(env, previous);
+}
+
+/**
+ * Get what Lua has allocated on behalf of the environment, or NULL if the
+ * Lua state doesn't keep track
+ */
+const scriptalloc_account_t* environment_get_memory(const environment_t* env) {
+    if (env->alloc == NULL) {
+        return NULL;
+    }
+
+    return scriptalloc_get_account(env->alloc, env->memory);
+}
+
+/**
+ * Limit how many bytes Lua can allocate on behalf of the environment, or 0
+ * for no limit
+ *
+ * Going over the limit raises a memory error in whatever script is running.
+ */
+void environment_set_memory_limit(environment_t* env, size_t limit) {
+    if (env->alloc != NULL) {
+        scriptalloc_set_limit(env->alloc, env->memory, limit);
+    }
+}
+
+/**
+ * Profile the Lua code of the environment from now on, or stop profiling it
+ * if the profiler is NULL
+ */
+void environment_set_profiler(environment_t* env, scriptprof_t* profiler) {
+    env->profiler = profiler;
 }
@@ -20,11 +20,15 @@
 #include "define.h"
 
 #include "input.h"
+#include "script.h"
+#include "scriptalloc.h"
 
 // Forward declarations.
 typedef struct entity_manager_s entity_manager_t;
+typedef struct inputscript_inputs_s inputscript_inputs_t;
 typedef struct lua_State lua_State;
 typedef struct proto_container_s proto_container_t;
+typedef struct scriptprof_s scriptprof_t;
 
 /**
  * Portable state - everything needed to get back to a previous state.
@@ -44,6 +48,12 @@ typedef struct portstate_s {
      * Gametic of serialized state
      */
     uint32_t gametic;
+
+    /**
+     * Player inputs of the gametic, so pressed and released inputs can be
+     * told apart after a rewind.
+     */
+    playerinputs_t inputs;
 } portstate_t;
 
 typedef struct environment_s {
@@ -54,6 +64,39 @@ typedef struct environment_s {
      */
     lua_State* lua;
 
+    /**
+     * Allocator of the Lua state, or NULL if it doesn't have one of ours.
+     *
+     * This pointer is not owned by this structure.  Do not free it.
+     */
+    scriptalloc_t* alloc;
+
+    /**
+     * Memory account that Lua allocations of the environment are charged to.
+     */
+    uint32_t memory;
+
+    /**
+     * True if the garbage collector was running before we stopped it to
+     * call into the environment.
+     */
+    bool collecting;
+
+    /**
+     * Number of collections of the garbage collection schedule the last
+     * time we looked, and how many frames have run since it changed.
+     */
+    uint32_t gc_collections;
+    uint32_t gc_frames;
+
+    /**
+     * Profiler that samples the environment while it runs, or NULL if the
+     * environment isn't being profiled.
+     *
+     * This pointer is not owned by this structure.  Do not free it.
+     */
+    scriptprof_t* profiler;
+
     /**
      * Reference to registry.
      */
@@ -74,6 +117,27 @@ typedef struct environment_s {
      */
     int state_ref;
 
+    /**
+     * References to the start, frame and draw functions of the ruleset
+     * module, so they don't have to be looked up every tic.
+     */
+    int start_ref;
+    int frame_ref;
+    int draw_ref;
+
+    /**
+     * Player inputs that we hand to the frame function, updated in place
+     * every tic.
+     *
+     * This is owned by the Lua state, and kept alive by inputs_ref.
+     */
+    inputscript_inputs_t* inputs;
+
+    /**
+     * Reference to the player inputs userdata.
+     */
+    int inputs_ref;
+
     /**
      * Last processed tic.
      */
@@ -89,6 +153,11 @@ typedef struct environment_s {
      */
     entity_manager_t* entities;
 
+    /**
+     * Native context handed to every script binding.
+     */
+    script_context_t context;
+
     /**
      * Serialized states.
      */
@@ -103,3 +172,6 @@ bool environment_save(environment_t* env);
 bool environment_rewind(environment_t* env, uint32_t frame);
 bool environment_frame(environment_t* env, const playerinputs_t* inputs);
 void environment_draw(environment_t* env);
+const scriptalloc_account_t* environment_get_memory(const environment_t* env);
+void environment_set_memory_limit(environment_t* env, size_t limit);
+void environment_set_profiler(environment_t* env, scriptprof_t* profiler);
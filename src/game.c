@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include "audio.h"
+#include "entity.h"
 #include "error.h"
 #include "frontend.h"
 #include "mainmenu.h"
@@ -29,6 +30,7 @@
 #include "ruleset.h"
 #include "screen.h"
 #include "script.h"
+#include "scriptprof.h"
 #include "vfs.h"
 
 /**
@@ -41,6 +43,65 @@ static screens_t g_screens;
  */
 static lua_State* g_lua;
 
+/**
+ * Most milliseconds per frame that we are willing to spend collecting
+ * garbage.
+ */
+static double g_gc_budget = GAME_GC_BUDGET;
+
+/**
+ * Profiler of the Lua code of the game, or NULL if we aren't profiling.
+ */
+static scriptprof_t* g_profiler;
+
+/**
+ * File to write the profile to when the game is done.
+ */
+static const char* g_profile_path;
+
+/**
+ * Parse the command line options that we care about
+ */
+static void game_parse_args(int argc, char** argv) {
+    for (int i = 1;i < argc;i++) {
+        if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            g_profile_path = argv[i + 1];
+            i += 1;
+        }
+    }
+}
+
+/**
+ * Write out the profile of the game
+ *
+ * Sampled stacks go to the profile file in the collapsed format that
+ * flamegraph tools read.  Calls into our C bindings and the occupancy of
+ * the entity pools go to stdout.
+ */
+static void game_write_profile(void) {
+    FILE* file = fopen(g_profile_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open profile %s\n", g_profile_path);
+        return;
+    }
+
+    scriptprof_write_stacks(g_profiler, file);
+    fclose(file);
+
+    printf("Profiled %u frames, %llu samples\n", scriptprof_get_frames(g_profiler),
+           (unsigned long long)scriptprof_get_samples(g_profiler));
+    scriptprof_write_calls(g_profiler, stdout);
+
+    // Occupancy of the entity pools, to see how many entities stick around.
+    const char* types[MINO_ENTITY_MAX] = { "entity", "random", "piece", "board", "rules" };
+    for (size_t i = 0;i < MINO_ENTITY_MAX;i++) {
+        entity_pool_stats_t stats;
+        entity_pool_get_stats((entity_type_t)i, &stats);
+        printf("%s pool: %zu of %zu blocks of %zu bytes in use, %zu slabs\n", types[i],
+               stats.used, stats.capacity, stats.size, stats.slabs);
+    }
+}
+
 /**
  * Initialize the game
  * 
@@ -72,6 +133,13 @@ bool game_init(int argc, char** argv) {
         return false;
     }
 
+    game_parse_args(argc, argv);
+    if (g_profile_path != NULL) {
+        if ((g_profiler = scriptprof_new(g_lua, SCRIPTPROF_DEFAULT_PERIOD)) == NULL) {
+            return false;
+        }
+    }
+
     // We start at the main menu.
     screen_t mainmenu = mainmenu_new(g_lua);
     if (mainmenu.config.type == SCREEN_NONE) {
@@ -91,11 +159,19 @@ void game_deinit(void) {
     // Destroy the screen stack.
     screens_deinit(&g_screens);
 
+    // Write out the profile before the state it came from goes away.
+    if (g_profiler != NULL) {
+        game_write_profile();
+        scriptprof_delete(g_profiler);
+        g_profiler = NULL;
+    }
+
     // Deinit subsystems.
     if (g_lua != NULL) {
-        lua_close(g_lua);
+        script_closestate(g_lua);
         g_lua = NULL;
     }
+    entity_pools_free();
 
     audio_deinit();
     render_deinit();
@@ -123,6 +199,11 @@ void* game_draw(void) {
     // Render the proper screen.
     screens_render(&g_screens);
 
+    // Drawing is the last thing we do every frame.
+    if (g_profiler != NULL) {
+        scriptprof_end_frame(g_profiler);
+    }
+
     // Display all non-fatal errors.
     char* err;
     while ((err = error_pop()) != NULL) {
@@ -132,3 +213,51 @@ void* game_draw(void) {
     // Return the context.
     return render()->context();
 }
+
+/**
+ * Give the garbage collector some of the time that is left in the frame
+ *
+ * Pass how many milliseconds are left before the next frame has to start.
+ * The collector never gets more than the configured budget.
+ */
+void game_collect(double available_ms) {
+    if (g_lua == NULL) {
+        return;
+    }
+
+    double budget = available_ms;
+    if (budget > g_gc_budget) {
+        budget = g_gc_budget;
+    }
+    if (budget <= 0.0) {
+        return;
+    }
+
+    script_gc_step(g_lua, script_get_gc(g_lua), budget);
+}
+
+/**
+ * Set the most milliseconds per frame to spend on garbage collection
+ */
+void game_set_gc_budget(double budget_ms) {
+    g_gc_budget = budget_ms;
+}
+
+/**
+ * Get the garbage collection schedule along with how long it has paused
+ * the game for
+ */
+const script_gc_t* game_get_gc(void) {
+    if (g_lua == NULL) {
+        return NULL;
+    }
+
+    return script_get_gc(g_lua);
+}
+
+/**
+ * Get the profiler of the game, or NULL if we aren't profiling
+ */
+scriptprof_t* game_get_profiler(void) {
+    return g_profiler;
+}
@@ -21,8 +21,19 @@
 
 // Forward declarations.
 typedef struct gameinputs_s gameinputs_t;
+typedef struct script_gc_s script_gc_t;
+typedef struct scriptprof_s scriptprof_t;
+
+/**
+ * Default number of milliseconds per frame that we spend collecting garbage.
+ */
+#define GAME_GC_BUDGET 2.0
 
 bool game_init(int argc, char** argv);
 void game_deinit(void);
 void game_frame(const gameinputs_t* inputs);
 void* game_draw(void);
+void game_collect(double available_ms);
+void game_set_gc_budget(double budget_ms);
+const script_gc_t* game_get_gc(void);
+scriptprof_t* game_get_profiler(void);
@@ -257,7 +257,7 @@ static int globalscript_require(lua_State* L) {
     }
 
     // Turn the buffer into a runnable chunk.
-    if (luaL_loadbufferx(L, (char*)file->data, file->size, file->filename, "t") != LUA_OK) {
+    if (script_load_chunk(L, file) != LUA_OK) {
         // Error was pushed to the stack
         goto fail;
     }
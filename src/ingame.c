@@ -22,6 +22,7 @@
 #include "audio.h"
 #include "environment.h"
 #include "error.h"
+#include "game.h"
 #include "gametype.h"
 #include "pausemenu.h"
 #include "ruleset.h"
@@ -205,6 +206,9 @@ screen_t ingame_new(ruleset_t* ruleset, gametype_t* gametype) {
         return screen;
     }
 
+    // Only profile the game once it's running.
+    environment_set_profiler(environment, game_get_profiler());
+
     ingame->environment = environment;
     ingame->ruleset = ruleset;
     ingame->gametype = gametype;
@@ -15,13 +15,14 @@
  * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "inputscript.h"
+
 #include <string.h>
 
 #include "lauxlib.h"
 
-#include "input.h"
-
 typedef struct {
+    inputscript_inputs_t* scriptinputs;
     playerinputs_t* playerinputs;
     size_t player;
 } isca_t;
@@ -35,7 +36,8 @@ static isca_t inputscript_check_args(lua_State* L) {
     isca_t ret;
 
     // Parameter 1: Our userdata
-    ret.playerinputs = luaL_checkudata(L, 1, "inputs_t");
+    ret.scriptinputs = luaL_checkudata(L, 1, "inputs_t");
+    ret.playerinputs = &ret.scriptinputs->current;
 
     // Parameter 2: Player number, 1-indexed.
     lua_Integer player = luaL_checkinteger(L, 2);
@@ -126,15 +128,65 @@ static int inputscript_check_180(lua_State* L) {
 }
 
 /**
- * Push a new inputs userdata to the stack.
+ * Get a particular player's raw input bitmask
  */
-void inputscript_push_inputs(lua_State* L, const playerinputs_t* inputs) {
-    // Copy our inputs into a new userdata
-    playerinputs_t* ud = lua_newuserdata(L, sizeof(playerinputs_t));
-    memcpy(ud, inputs, sizeof(*ud));
+static int inputscript_mask(lua_State* L) {
+    isca_t args = inputscript_check_args(L);
+    lua_pushinteger(L, args.scriptinputs->current.inputs[args.player]);
+    return 1;
+}
+
+/**
+ * Get the inputs that a particular player started holding this tic
+ *
+ * Pass a mask of inputs as the third parameter to only check those inputs.
+ */
+static int inputscript_pressed(lua_State* L) {
+    isca_t args = inputscript_check_args(L);
+    lua_Integer mask = luaL_optinteger(L, 3, ~(lua_Integer)0);
+
+    inputs_t current = args.scriptinputs->current.inputs[args.player];
+    inputs_t previous = args.scriptinputs->previous.inputs[args.player];
+    lua_pushinteger(L, current & ~previous & mask);
+    return 1;
+}
+
+/**
+ * Get the inputs that a particular player let go of this tic
+ *
+ * Pass a mask of inputs as the third parameter to only check those inputs.
+ */
+static int inputscript_released(lua_State* L) {
+    isca_t args = inputscript_check_args(L);
+    lua_Integer mask = luaL_optinteger(L, 3, ~(lua_Integer)0);
+
+    inputs_t current = args.scriptinputs->current.inputs[args.player];
+    inputs_t previous = args.scriptinputs->previous.inputs[args.player];
+    lua_pushinteger(L, previous & ~current & mask);
+    return 1;
+}
+
+/**
+ * Push a new inputs userdata to the stack, with nothing held.
+ *
+ * The userdata is meant to be kept around and updated in place every tic
+ * with inputscript_update_inputs, so we don't make garbage every tic.
+ */
+inputscript_inputs_t* inputscript_push_new_inputs(lua_State* L) {
+    inputscript_inputs_t* ud = lua_newuserdata(L, sizeof(inputscript_inputs_t));
+    memset(ud, 0, sizeof(*ud));
 
     // Apply methods to the inputs
     luaL_setmetatable(L, "inputs_t");
+    return ud;
+}
+
+/**
+ * Move on to the inputs of the next tic.
+ */
+void inputscript_update_inputs(inputscript_inputs_t* ud, const playerinputs_t* inputs) {
+    ud->previous = ud->current;
+    ud->current = *inputs;
 }
 
 /**
@@ -150,15 +202,39 @@ int inputscript_openlib(lua_State* L) {
         { "check_cw", inputscript_check_cw },
         { "check_hold", inputscript_check_hold },
         { "check_180", inputscript_check_180 },
+        { "mask", inputscript_mask },
+        { "pressed", inputscript_pressed },
+        { "released", inputscript_released },
         { NULL, NULL }
     };
 
+    static const struct {
+        const char* name;
+        input_t input;
+    } inputbits[] = {
+        { "LEFT", INPUT_LEFT },
+        { "RIGHT", INPUT_RIGHT },
+        { "SOFTDROP", INPUT_SOFTDROP },
+        { "HARDDROP", INPUT_HARDDROP },
+        { "CCW", INPUT_CCW },
+        { "CW", INPUT_CW },
+        { "HOLD", INPUT_HOLD },
+        { "ROTATE_180", INPUT_180 },
+    };
+
     luaL_newmetatable(L, "inputs_t");
 
+    // The methods double as our module, along with the input bits that
+    // the masks are made of.
     luaL_newlib(L, inputstype);
-    lua_setfield(L, -2, "__index");
-
-    lua_pop(L, 1);
+    for (size_t i = 0;i < ARRAY_LEN(inputbits);i++) {
+        lua_pushinteger(L, inputbits[i].input);
+        lua_setfield(L, -2, inputbits[i].name);
+    }
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, "__index");
+
+    lua_remove(L, -2);
 
     return 1;
 }
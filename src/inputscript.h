@@ -17,9 +17,27 @@
 
 #pragma once
 
+#include "input.h"
+
 // Forward declarations.
 typedef struct lua_State lua_State;
-typedef struct playerinputs_s playerinputs_t;
 
-void inputscript_push_inputs(lua_State* L, const playerinputs_t* inputs);
+/**
+ * Contents of an inputs userdata.
+ */
+typedef struct inputscript_inputs_s {
+    /**
+     * Inputs of the current tic.  This must come first, so the userdata can
+     * be read as plain player inputs.
+     */
+    playerinputs_t current;
+
+    /**
+     * Inputs of the tic before, so we can tell what changed.
+     */
+    playerinputs_t previous;
+} inputscript_inputs_t;
+
+inputscript_inputs_t* inputscript_push_new_inputs(lua_State* L);
+void inputscript_update_inputs(inputscript_inputs_t* ud, const playerinputs_t* inputs);
 int inputscript_openlib(lua_State* L);
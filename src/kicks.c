@@ -0,0 +1,169 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+
+#include "kicks.h"
+
+/**
+ * Read the tests of every source rotation for one direction
+ *
+ * Assumes the table of tests for that direction is on the top of the Lua
+ * stack, and leaves it there.  Returns an error message on failure.
+ */
+static const char* kicks_config_read_dir(lua_State* L, kicks_config_t* kicks, rotate_dir_t dir) {
+    for (uint8_t r = 0;r < kicks->rot_count;r++) {
+        if (lua_rawgeti(L, -1, r + 1) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            return "Kick tests for a rotation aren't a table";
+        }
+
+        if (luaL_len(L, -1) != kicks->test_count * 2) {
+            lua_pop(L, 1);
+            return "Every rotation must have the same number of kick tests";
+        }
+
+        vec2i_t* tests = kicks->tests + (dir * kicks->rot_count + r) * kicks->test_count;
+        for (uint8_t i = 0;i < kicks->test_count;i++) {
+            lua_rawgeti(L, -1, i * 2 + 1);
+            tests[i].x = (int)lua_tointeger(L, -1);
+            lua_rawgeti(L, -2, i * 2 + 2);
+            tests[i].y = (int)lua_tointeger(L, -1);
+            lua_pop(L, 2);
+        }
+        lua_pop(L, 1); // pop rotation tests
+    }
+
+    return NULL;
+}
+
+/**
+ * Allocates a kick table from the table at the top of the Lua stack
+ *
+ * The table has a "cw" and a "ccw" member, each holding one array of tests
+ * per source rotation.  Every array of tests is a flat list of x, y offset
+ * pairs, tried in order.
+ *
+ * Assumes you have a kick table on the top of the Lua stack.  Consumes the
+ * table from the Lua stack and leaves nothing on success, or an error message
+ * on failure.
+ */
+kicks_config_t* kicks_config_new(lua_State* L, const char* name) {
+    static const char* dirs[MINO_ROTATE_MAX] = { "cw", "ccw" };
+
+    int top = lua_gettop(L);
+
+    const char* error = NULL;
+    kicks_config_t* kicks = NULL;
+
+    if ((kicks = calloc(1, sizeof(kicks_config_t))) == NULL) {
+        error = "Allocation error";
+        goto fail;
+    }
+
+    if ((kicks->name = strdup(name)) == NULL) {
+        error = "Allocation error";
+        goto fail;
+    }
+
+    // Size everything off of the first test of the clockwise table.
+    if (lua_getfield(L, -1, "cw") != LUA_TTABLE) {
+        error = "Kicks \"cw\" isn't a table";
+        goto fail;
+    }
+    lua_Integer rot_count = luaL_len(L, -1);
+    lua_Integer test_count = 0;
+    if (lua_rawgeti(L, -1, 1) == LUA_TTABLE) {
+        test_count = luaL_len(L, -1) / 2;
+    }
+    lua_pop(L, 2); // pop first test, cw
+
+    if (rot_count <= 0 || rot_count > UINT8_MAX || test_count <= 0 || test_count > UINT8_MAX) {
+        error = "Kicks must have at least one test for every rotation";
+        goto fail;
+    }
+    kicks->rot_count = (uint8_t)rot_count;
+    kicks->test_count = (uint8_t)test_count;
+
+    kicks->tests = calloc(MINO_ROTATE_MAX * rot_count * test_count, sizeof(vec2i_t));
+    if (kicks->tests == NULL) {
+        error = "Allocation error";
+        goto fail;
+    }
+
+    for (int dir = 0;dir < MINO_ROTATE_MAX;dir++) {
+        if (lua_getfield(L, -1, dirs[dir]) != LUA_TTABLE) {
+            error = (dir == MINO_ROTATE_CW) ?
+                "Kicks \"cw\" isn't a table" : "Kicks \"ccw\" isn't a table";
+            goto fail;
+        }
+
+        if (luaL_len(L, -1) != rot_count) {
+            error = "Kicks \"cw\" and \"ccw\" have a different number of rotations";
+            goto fail;
+        }
+
+        if ((error = kicks_config_read_dir(L, kicks, dir)) != NULL) {
+            goto fail;
+        }
+        lua_pop(L, 1); // pop direction
+    }
+    lua_pop(L, 1); // pop kicks table
+
+    return kicks;
+
+fail:
+    lua_settop(L, top); // reset stack to previous position
+    lua_pushstring(L, error); // push error
+    kicks_config_delete(kicks);
+    return NULL;
+}
+
+/**
+ * Frees a kick table
+ */
+void kicks_config_delete(kicks_config_t* kicks_config) {
+    if (kicks_config == NULL) {
+        return;
+    }
+
+    free(kicks_config->name);
+    kicks_config->name = NULL;
+    free(kicks_config->tests);
+    kicks_config->tests = NULL;
+
+    free(kicks_config);
+}
+
+/**
+ * A generic destructor for the kick table
+ */
+void kicks_config_destruct(void* kicks_config) {
+    kicks_config_delete((kicks_config_t*)kicks_config);
+}
+
+/**
+ * Get the tests for rotating away from a particular rotation.
+ *
+ * There are always test_count tests.
+ */
+const vec2i_t* kicks_config_get_tests(const kicks_config_t* kicks, uint8_t rot, rotate_dir_t dir) {
+    return kicks->tests + (dir * kicks->rot_count + rot) * kicks->test_count;
+}
@@ -0,0 +1,67 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "define.h"
+
+// Forward declarations.
+typedef struct lua_State lua_State;
+
+/**
+ * Direction of a rotation.
+ */
+typedef enum {
+    MINO_ROTATE_CW,
+    MINO_ROTATE_CCW,
+    MINO_ROTATE_MAX
+} rotate_dir_t;
+
+/**
+ * Wallkick tests of a rotation system.
+ */
+typedef struct kicks_config_s {
+    /**
+     * Name of the kick table.
+     */
+    char* name;
+
+    /**
+     * How many rotations the kick table has tests for.  Must match the
+     * number of rotations of any piece that uses it.
+     */
+    uint8_t rot_count;
+
+    /**
+     * How many tests are run for every rotation.
+     */
+    uint8_t test_count;
+
+    /**
+     * Position offsets of every test, in order of preference.
+     *
+     * Offsets are in board coordinates, so positive y is down.  Tests are
+     * grouped by direction first, then by source rotation, and total size
+     * of this pointer is MINO_ROTATE_MAX * rot_count * test_count.
+     */
+    vec2i_t* tests;
+} kicks_config_t;
+
+kicks_config_t* kicks_config_new(lua_State* L, const char* name);
+void kicks_config_delete(kicks_config_t* kicks_config);
+void kicks_config_destruct(void* kicks_config);
+const vec2i_t* kicks_config_get_tests(const kicks_config_t* kicks, uint8_t rot, rotate_dir_t dir);
@@ -215,6 +215,10 @@ RETRO_API void retro_run(void) {
     softrender_context_t* render_ctx = game_draw();
     video_cb(render_ctx->buffer.data, render_ctx->buffer.width, render_ctx->buffer.height, render_ctx->buffer.width * 4);
 
+    // The frontend doesn't tell us how much of the frame is left, so give
+    // the collector its usual budget.
+    game_collect(1000.0 / MINO_FPS);
+
     // Play a tic worth of audio.
     audio_context_t* audio_ctx = audio_frame(MINO_AUDIO_HZ / MINO_FPS);
     audio_batch_cb(audio_ctx->sampledata, audio_ctx->framecount);
@@ -190,6 +190,51 @@ void picture_copy(picture_t* restrict dest, vec2i_t dstpos,
     }
 }
 
+/**
+ * Copy an area of one picture on top of another.
+ */
+void picture_copy_area(picture_t* restrict dest, vec2i_t dstpos,
+                       const picture_t* restrict source, vec2i_t srcpos, vec2i_t len) {
+    // Where in the pixel data does our copying begin?
+    int srccursor = (srcpos.y * source->width * MINO_PICTURE_BPP) + (srcpos.x * MINO_PICTURE_BPP);
+    int dstcursor = (dstpos.y * dest->width * MINO_PICTURE_BPP) + (dstpos.x * MINO_PICTURE_BPP);
+
+    // Neither picture might be big enough for the whole area.
+    int copywidth = len.x, copyheight = len.y;
+    if (copywidth > source->width - srcpos.x) {
+        copywidth = source->width - srcpos.x;
+    }
+    if (copywidth > dest->width - dstpos.x) {
+        copywidth = dest->width - dstpos.x;
+    }
+    if (copyheight > source->height - srcpos.y) {
+        copyheight = source->height - srcpos.y;
+    }
+    if (copyheight > dest->height - dstpos.y) {
+        copyheight = dest->height - dstpos.y;
+    }
+
+    for (int y = 0;y < copyheight;y++) {
+        memcpy(dest->data + dstcursor, source->data + srccursor, copywidth * MINO_PICTURE_BPP);
+        srccursor += source->width * MINO_PICTURE_BPP;
+        dstcursor += dest->width * MINO_PICTURE_BPP;
+    }
+}
+
+/**
+ * Scale the alpha of every pixel of a picture in place.
+ *
+ * Blitting the result looks the same as blitting the original with
+ * picture_blit_alpha and the same alpha value.
+ */
+void picture_scale_alpha(picture_t* pic, uint8_t alpha) {
+    uint_fast16_t scale = alpha + 1;
+    for (size_t i = 0;i < pic->size;i += MINO_PICTURE_BPP) {
+        uint_fast16_t srcfalpha = pic->data[i + 3] << 8;
+        pic->data[i + 3] = (uint8_t)((srcfalpha * scale) >> 16);
+    }
+}
+
 /**
  * Blit one picture on top of another, taking alpha into account.
  */
@@ -47,6 +47,9 @@ void picture_delete(picture_t* pic);
 void picture_box(picture_t* dest, vec2i_t pos, vec2i_t len);
 void picture_copy(picture_t* restrict dest, vec2i_t dstpos,
                   const picture_t* restrict source, vec2i_t srcpos);
+void picture_copy_area(picture_t* restrict dest, vec2i_t dstpos,
+                       const picture_t* restrict source, vec2i_t srcpos, vec2i_t len);
+void picture_scale_alpha(picture_t* pic, uint8_t alpha);
 void picture_blit(picture_t* restrict dest, vec2i_t dstpos,
                   const picture_t* restrict source, vec2i_t srcpos);
 void picture_blit_alpha(picture_t* restrict dest, vec2i_t dstpos,
@@ -15,6 +15,7 @@
  * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -29,6 +30,53 @@
 #include "script.h"
 #include "serialize.h"
 
+/**
+ * Precompute the occupancy of every rotation of a piece configuration
+ */
+static bool piece_config_init_shapes(piece_config_t* piece) {
+    piece->shapes = calloc(piece->data_count, sizeof(piece_shape_t));
+    if (piece->shapes == NULL) {
+        return false;
+    }
+
+    for (size_t r = 0;r < piece->data_count;r++) {
+        piece_shape_t* shape = &piece->shapes[r];
+        const uint8_t* data = piece_config_get_rot(piece, r);
+
+        shape->rows = calloc(piece->height, sizeof(rowmask_t));
+        shape->cells = calloc(piece->data_size, sizeof(piece_cell_t));
+        if (shape->rows == NULL || shape->cells == NULL) {
+            return false;
+        }
+
+        shape->min = vec2i(piece->width, piece->height);
+        shape->max = vec2i(-1, -1);
+        memset(shape->bottoms, -1, sizeof(shape->bottoms));
+        for (uint8_t y = 0;y < piece->height;y++) {
+            for (uint8_t x = 0;x < piece->width;x++) {
+                uint8_t value = data[y * piece->width + x];
+                if (!value) {
+                    continue;
+                }
+
+                shape->rows[y] |= (rowmask_t)1 << x;
+                shape->cells[shape->cell_count].x = x;
+                shape->cells[shape->cell_count].y = y;
+                shape->cells[shape->cell_count].value = value;
+                shape->cell_count += 1;
+
+                if (x < shape->min.x) { shape->min.x = x; }
+                if (y < shape->min.y) { shape->min.y = y; }
+                if (x > shape->max.x) { shape->max.x = x; }
+                if (y > shape->max.y) { shape->max.y = y; }
+                shape->bottoms[x] = y;
+            }
+        }
+    }
+
+    return true;
+}
+
 /**
  * Allocates a piece configuration from the table at the top of the Lua stack
  * 
@@ -59,7 +107,7 @@ piece_config_t* piece_config_new(lua_State* L, const char* name) {
     lua_pop(L, 1); // pop spawn_pos
 
     lua_getfield(L, -1, "spawn_rot");
-    uint8_t spawn_rot = (uint8_t)lua_tointeger(L, -1);
+    lua_Integer spawn_rot = lua_tointeger(L, -1);
     lua_pop(L, 1); // pop spawn_rot
 
     lua_getfield(L, -1, "width");
@@ -70,6 +118,12 @@ piece_config_t* piece_config_new(lua_State* L, const char* name) {
     uint8_t height = (uint8_t)lua_tointeger(L, -1);
     lua_pop(L, 1); // pop height
 
+    // Each row of a piece has to fit inside a single row mask
+    if (width == 0 || width > ROWMASK_WIDTH || height == 0) {
+        error = "Piece \"width\" or \"height\" is out of range";
+        goto fail;
+    }
+
     // Data is a contiguous array of integers
     int type = lua_getfield(L, -1, "data");
     if (type != LUA_TTABLE) {
@@ -77,7 +131,21 @@ piece_config_t* piece_config_new(lua_State* L, const char* name) {
         goto fail;
     }
 
+    // Data must hold a whole number of rotations, and at least one
+    lua_Integer data_size = width * height;
     lua_Integer data_length = luaL_len(L, -1);
+    if (data_length <= 0 || data_length % data_size != 0 ||
+        data_length / data_size > UINT8_MAX) {
+        error = "Piece \"data\" isn't a whole number of rotations";
+        goto fail;
+    }
+
+    lua_Integer data_count = data_length / data_size;
+    if (spawn_rot < 0 || spawn_rot >= data_count) {
+        error = "Piece \"spawn_rot\" is out of range";
+        goto fail;
+    }
+
     uint8_t* data = calloc(data_length, sizeof(uint8_t));
     if (data == NULL) {
         error = "Allocation error";
@@ -95,6 +163,7 @@ piece_config_t* piece_config_new(lua_State* L, const char* name) {
 
     piece = calloc(1, sizeof(piece_config_t));
     if (piece == NULL) {
+        free(data);
         error_push_allocerr();
         goto fail;
     }
@@ -102,11 +171,17 @@ piece_config_t* piece_config_new(lua_State* L, const char* name) {
     piece->name = namedup;
     piece->data = data;
     piece->spawn_pos = spawn_pos;
-    piece->spawn_rot = spawn_rot;
+    piece->spawn_rot = (uint8_t)spawn_rot;
     piece->width = width;
     piece->height = height;
-    piece->data_size = width * height * sizeof(piece->data[0]);
-    piece->data_count = data_length / piece->data_size;
+    piece->data_size = (size_t)data_size;
+    piece->data_count = (uint8_t)data_count;
+
+    if (piece_config_init_shapes(piece) == false) {
+        namedup = NULL; // owned by the piece now
+        error = "Allocation error";
+        goto fail;
+    }
 
     return piece;
 
@@ -128,6 +203,15 @@ void piece_config_delete(piece_config_t* piece_config) {
 
     free(piece_config->name);
     piece_config->name = NULL;
+    if (piece_config->shapes != NULL) {
+        for (size_t i = 0;i < piece_config->data_count;i++) {
+            free(piece_config->shapes[i].rows);
+            free(piece_config->shapes[i].cells);
+        }
+        free(piece_config->shapes);
+        piece_config->shapes = NULL;
+    }
+
     free(piece_config->data);
     piece_config->data = NULL;
 
@@ -148,14 +232,21 @@ uint8_t* piece_config_get_rot(const piece_config_t* piece, uint8_t rot) {
     return piece->data + (rot * piece->data_size);
 }
 
+/**
+ * Get the precomputed occupancy of a particular rotation.
+ */
+const piece_shape_t* piece_config_get_shape(const piece_config_t* piece, uint8_t rot) {
+    assert(rot < piece->data_count);
+    return &piece->shapes[rot];
+}
+
 /**
  * Initialize a new piece on the board.
  */
 piece_t* piece_new(const piece_config_t* config) {
     piece_t* piece = NULL;
 
-    if ((piece = calloc(1, sizeof(piece_t))) == NULL) {
-        error_push_allocerr();
+    if ((piece = entity_pool_alloc(MINO_ENTITY_PIECE, sizeof(piece_t))) == NULL) {
         return NULL;
     }
 
@@ -168,7 +259,7 @@ piece_t* piece_new(const piece_config_t* config) {
  * Delete a piece on the board.
  */
 void piece_delete(piece_t* piece) {
-    free(piece);
+    entity_pool_free(MINO_ENTITY_PIECE, piece);
 }
 
 /**
@@ -21,9 +21,63 @@
 
 // Forward declarations.
 typedef struct entity_s entity_t;
+typedef struct kicks_config_s kicks_config_t;
 typedef struct lua_State lua_State;
 typedef struct mpack_writer_t mpack_writer_t;
 
+/**
+ * A single occupied cell of a piece.
+ */
+typedef struct {
+    /**
+     * Position of the cell relative to the top-left of the piece.
+     */
+    uint8_t x;
+    uint8_t y;
+
+    /**
+     * Contents of the cell.
+     */
+    uint8_t value;
+} piece_cell_t;
+
+/**
+ * Precomputed occupancy of a single rotation of a piece.
+ */
+typedef struct {
+    /**
+     * Occupancy of every row of the rotation, 'height' entries long.
+     */
+    rowmask_t* rows;
+
+    /**
+     * Every occupied cell of the rotation, in row-major order.
+     */
+    piece_cell_t* cells;
+
+    /**
+     * Number of occupied cells.
+     */
+    size_t cell_count;
+
+    /**
+     * Top-left corner of the tight bounding box of occupied cells.
+     */
+    vec2i_t min;
+
+    /**
+     * Bottom-right corner of the tight bounding box of occupied cells,
+     * inclusive.  If there are no occupied cells, this is less than min.
+     */
+    vec2i_t max;
+
+    /**
+     * Lowest occupied cell of every column of the rotation, or -1 if the
+     * column is empty.  Only the first 'width' entries are used.
+     */
+    int8_t bottoms[ROWMASK_WIDTH];
+} piece_shape_t;
+
 typedef struct piece_config_s {
     /**
      * Name of the piece.
@@ -57,6 +111,11 @@ typedef struct piece_config_s {
      */
     uint8_t data_count;
 
+    /**
+     * Precomputed occupancy of every rotation, data_count entries long.
+     */
+    piece_shape_t* shapes;
+
     /**
      * Spawn position of piece.
      */
@@ -66,6 +125,20 @@ typedef struct piece_config_s {
      * Initial rotation of piece.
      */
     uint8_t spawn_rot;
+
+    /**
+     * Wallkick tests used when rotating the piece, or NULL if the piece only
+     * rotates in place.
+     *
+     * The piece does not own this pointer, it belongs to its prototype.
+     */
+    const kicks_config_t* kicks;
+
+    /**
+     * Handle of the prototype that the piece was loaded as, or 0 if the
+     * piece isn't a prototype.
+     */
+    size_t proto_handle;
 } piece_config_t;
 
 typedef struct piece_s {
@@ -81,6 +154,7 @@ piece_config_t* piece_config_new(lua_State* L, const char* name);
 void piece_config_delete(piece_config_t* piece_config);
 void piece_config_destruct(void* piece_config);
 uint8_t* piece_config_get_rot(const piece_config_t* piece, uint8_t rot);
+const piece_shape_t* piece_config_get_shape(const piece_config_t* piece, uint8_t rot);
 piece_t* piece_new(const piece_config_t* config);
 void piece_delete(piece_t* piece);
 void piece_serialize(piece_t* piece, mpack_writer_t* writer);
@@ -21,37 +21,19 @@
 #include "entityscript.h"
 #include "piece.h"
 #include "proto.h"
+#include "protoscript.h"
 #include "script.h"
 
 /**
  * Lua: Initialize new piece state.
  */
 static int piecescript_create(lua_State* L) {
-    // Parameter 1: Piece configuration
-    const char* piece_config = luaL_checkstring(L, 1);
+    // Parameter 1: Piece prototype
+    proto_t* proto = protoscript_check_proto(L, 1, MINO_PROTO_PIECE);
 
     // Internal State 1: Entity manager
-    int type = lua_getfield(L, lua_upvalueindex(1), "entity_manager");
-    if (type != LUA_TLIGHTUSERDATA) {
-        luaL_error(L, "missing internal state (entity_manager)");
-        return 0;
-    }
-    entity_manager_t* manager = lua_touserdata(L, -1);
-
-    // Internal State 2: Prototype hash
-    type = lua_getfield(L, lua_upvalueindex(1), "proto_hash");
-    if (type != LUA_TTABLE) {
-        luaL_error(L, "missing internal state (proto_hash)");
-        return 0;
-    }
+    entity_manager_t* manager = script_to_context(L)->entities;
 
-    // Get the piece configuration
-    lua_getfield(L, -1, piece_config);
-    proto_t* proto = lua_touserdata(L, -1);
-    if (proto == NULL || proto->type != MINO_PROTO_PIECE) {
-        luaL_error(L, "invalid piece configuration");
-        return 0;
-    }
     piece_config_t* config = proto->data;
 
     // Allocate the entity
@@ -89,6 +71,20 @@ static int piecescript_config_name(lua_State* L) {
     return 1;
 }
 
+/**
+ * Lua: Get the prototype handle of the configuration of a piece.
+ *
+ * The handle can be passed to the board functions in place of the name.
+ */
+static int piecescript_config_proto(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_PIECE);
+    piece_t* piece = entity->data;
+
+    lua_pushinteger(L, (lua_Integer)piece->config->proto_handle);
+    return 1;
+}
+
 /**
  * Lua: Get the number of rotations that a piece has.
  */
@@ -101,6 +97,18 @@ static int piecescript_config_spawn_pos(lua_State* L) {
     return 1;
 }
 
+/**
+ * Lua: Get the spawn position of a piece as x and y.
+ */
+static int piecescript_config_spawn_pos_xy(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_PIECE);
+    piece_t* piece = entity->data;
+
+    script_push_xy(L, &piece->config->spawn_pos);
+    return 2;
+}
+
 /**
  * Lua: Get the number of rotations that a piece has.
  */
@@ -132,7 +140,9 @@ int piecescript_openlib(lua_State* L) {
     static const luaL_Reg piecelib[] = {
         { "create", piecescript_create },
         { "config_name", piecescript_config_name },
+        { "config_proto", piecescript_config_proto },
         { "config_spawn_pos", piecescript_config_spawn_pos },
+        { "config_spawn_pos_xy", piecescript_config_spawn_pos_xy },
         { "config_spawn_rot", piecescript_config_spawn_rot },
         { "config_rot_count", piecescript_config_rot_count },
         { NULL, NULL }
@@ -47,6 +47,12 @@ typedef struct {
      * Get a 32-bit random seed for the random number generator.
      */
     bool (*random_get_seed)(uint32_t* seed);
+
+    /**
+     * Get the time in milliseconds from a clock that never goes backwards.
+     * Only the difference between two calls means anything.
+     */
+    double (*clock_ms)(void);
 } platform_module_t;
 
 bool platform_init(void);
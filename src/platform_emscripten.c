@@ -20,6 +20,8 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include <emscripten.h>
+
 static bool emscripten_init(void) {
     srand(time(NULL));
     return true;
@@ -47,10 +49,15 @@ static bool emscripten_random_get_seed(uint32_t* seed) {
     return true;
 }
 
+static double emscripten_clock_ms(void) {
+    return emscripten_get_now();
+}
+
 platform_module_t g_platform_module = {
     emscripten_init,
     emscripten_deinit,
     emscripten_config_dir,
     emscripten_data_dirs,
-    emscripten_random_get_seed
+    emscripten_random_get_seed,
+    emscripten_clock_ms
 };
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "error.h"
 #include "vfs.h"
@@ -242,10 +243,17 @@ static bool unix_random_get_seed(uint32_t* seed) {
     return true;
 }
 
+static double unix_clock_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
+
 platform_module_t g_platform_module = {
     unix_init,
     unix_deinit,
     unix_config_dir,
     unix_data_dirs,
-    unix_random_get_seed
+    unix_random_get_seed,
+    unix_clock_ms
 };
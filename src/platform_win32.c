@@ -76,10 +76,18 @@ static bool win32_random_get_seed(uint32_t* seed) {
     return true;
 }
 
+static double win32_clock_ms(void) {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+
 platform_module_t g_platform_module = {
     win32_init,
     win32_deinit,
     win32_config_dir,
     win32_data_dirs,
-    win32_random_get_seed
+    win32_random_get_seed,
+    win32_clock_ms
 };
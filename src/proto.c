@@ -131,6 +131,28 @@ bool proto_container_push(proto_container_t* protos, proto_t* proto) {
     return true;
 }
 
+/**
+ * Get the number of prototypes in the container.
+ */
+size_t proto_container_count(const proto_container_t* protos) {
+    return protos->size;
+}
+
+/**
+ * Get a prototype from the container by the order it was pushed in.
+ *
+ * Prototypes are never removed from the container, so the index of a
+ * prototype stays the same for as long as the container is around.
+ * Returns NULL if the index is out of range.
+ */
+proto_t* proto_container_get(const proto_container_t* protos, size_t index) {
+    if (index >= protos->size) {
+        return NULL;
+    }
+
+    return protos->data[index];
+}
+
 /**
  * Allocate a new prototype
  */
@@ -30,7 +30,8 @@ typedef struct proto_container_s proto_container_t;
 typedef enum {
     MINO_PROTO_NONE,
     MINO_PROTO_PIECE,
-    MINO_PROTO_BOARD
+    MINO_PROTO_BOARD,
+    MINO_PROTO_KICKS
 } proto_type_t;
 
 /**
@@ -63,5 +64,7 @@ typedef struct proto_s {
 proto_container_t* proto_container_new(void);
 void proto_container_delete(proto_container_t* protos);
 bool proto_container_push(proto_container_t* protos, proto_t* proto);
+size_t proto_container_count(const proto_container_t* protos);
+proto_t* proto_container_get(const proto_container_t* protos, size_t index);
 proto_t* proto_new(proto_type_t type, void* data, proto_destruct_t destruct);
 void proto_delete(proto_t* proto);
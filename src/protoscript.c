@@ -20,16 +20,66 @@
 #include "lua.h"
 #include "lauxlib.h"
 
+#include "board.h"
+#include "kicks.h"
 #include "piece.h"
 #include "proto.h"
+#include "protoscript.h"
 #include "script.h"
 
+/**
+ * Get a prototype of a specific type from a Lua function argument.
+ *
+ * The argument can either be the handle that was returned when the
+ * prototype was loaded, or the name of the prototype.  Handles are looked up
+ * directly in the prototype container, so scripts that hold on to them skip
+ * the lookup by name entirely.  Raises a Lua error if the argument isn't a
+ * prototype of the right type.
+ *
+ * Must be called from a function that has the registry as its first upvalue.
+ */
+proto_t* protoscript_check_proto(lua_State* L, int arg, proto_type_t type) {
+    proto_t* proto = NULL;
+
+    if (lua_type(L, arg) == LUA_TNUMBER) {
+        lua_Integer handle = luaL_checkinteger(L, arg);
+
+        // Internal State 1: protos container
+        proto_container_t* protos = script_to_context(L)->protos;
+
+        if (handle > 0) {
+            proto = proto_container_get(protos, (size_t)(handle - 1));
+        }
+    } else {
+        const char* name = luaL_checkstring(L, arg);
+
+        // Internal State 1: protos table
+        if (lua_getfield(L, lua_upvalueindex(1), "proto_hash") != LUA_TTABLE) {
+            luaL_error(L, "missing internal state (proto_hash)");
+            return NULL;
+        }
+        lua_getfield(L, -1, name); // push prototype
+        proto = lua_touserdata(L, -1);
+        lua_pop(L, 2); // pop prototype and protos table
+    }
+
+    if (proto == NULL || proto->type != type) {
+        luaL_argerror(L, arg, "invalid prototype");
+        return NULL;
+    }
+
+    return proto;
+}
+
 /**
  * Lua: Load a prototype.
+ *
+ * Returns a handle to the prototype, which can be passed anywhere the name
+ * of the prototype can.
  */
 int protoscript_load(lua_State* L) {
     static const char* types[] = {
-        "piece", NULL
+        "piece", "board", "kicks", NULL
     };
 
     // Parameter 1: prototype type
@@ -49,33 +99,50 @@ int protoscript_load(lua_State* L) {
     }
 
     // Internal State 2: protos container
-    type = lua_getfield(L, lua_upvalueindex(1), "proto_container");
-    if (type != LUA_TLIGHTUSERDATA) {
-        luaL_error(L, "require: missing internal state (proto_container)");
-        return 0;
-    }
-    proto_container_t* protos = lua_touserdata(L, -1);
+    proto_container_t* protos = script_to_context(L)->protos;
 
     // First check to see if we're pushing a duplicate prototype
-    if (lua_getfield(L, -2, name) != LUA_TNIL) {
+    if (lua_getfield(L, -1, name) != LUA_TNIL) {
         luaL_error(L, "require: prototype \"%s\" already exists", name);
         return 0;
     }
     lua_pop(L, 1); // pop nil
 
-    lua_pushvalue(L, -3); // push dupe configuration
+    lua_pushvalue(L, -2); // push dupe configuration
 
     // Depending on our prototype type, create a different prototype
     proto_t* proto = NULL;
 
     switch (option) {
     case 0: {
+        // Pieces can name a kick table that has already been loaded.
+        const kicks_config_t* kicks = NULL;
+        if (lua_getfield(L, -1, "kicks") == LUA_TSTRING) {
+            lua_getfield(L, -3, lua_tostring(L, -1));
+            proto_t* kicks_proto = lua_touserdata(L, -1);
+            if (kicks_proto == NULL || kicks_proto->type != MINO_PROTO_KICKS) {
+                luaL_error(L, "require: piece \"%s\" has unknown kicks \"%s\"",
+                           name, lua_tostring(L, -2));
+                return 0;
+            }
+            kicks = kicks_proto->data;
+            lua_pop(L, 1); // pop kicks prototype
+        }
+        lua_pop(L, 1); // pop kicks name
+
         piece_config_t* piece = piece_config_new(L, name); // pops config
         if (piece == NULL) {
             luaL_error(L, "require: could not create piece:\n\t%s", lua_tostring(L, -1));
             return 0;
         }
 
+        if (kicks != NULL && kicks->rot_count != piece->data_count) {
+            piece_config_delete(piece);
+            luaL_error(L, "require: piece \"%s\" doesn't fit its kicks", name);
+            return 0;
+        }
+        piece->kicks = kicks;
+
         proto = proto_new(MINO_PROTO_PIECE, piece, piece_config_destruct);
         if (proto == NULL) {
             piece_config_delete(piece);
@@ -86,6 +153,40 @@ int protoscript_load(lua_State* L) {
         lua_pushlightuserdata(L, proto); // push prototype for hash
         break;
     }
+    case 1: {
+        board_config_t* board = board_config_new(L); // pops config
+        if (board == NULL) {
+            luaL_error(L, "require: could not create board:\n\t%s", lua_tostring(L, -1));
+            return 0;
+        }
+
+        proto = proto_new(MINO_PROTO_BOARD, board, board_config_destruct);
+        if (proto == NULL) {
+            board_config_delete(board);
+            luaL_error(L, "require: could not create prototype");
+            return 0;
+        }
+
+        lua_pushlightuserdata(L, proto); // push prototype for hash
+        break;
+    }
+    case 2: {
+        kicks_config_t* kicks = kicks_config_new(L, name); // pops config
+        if (kicks == NULL) {
+            luaL_error(L, "require: could not create kicks:\n\t%s", lua_tostring(L, -1));
+            return 0;
+        }
+
+        proto = proto_new(MINO_PROTO_KICKS, kicks, kicks_config_destruct);
+        if (proto == NULL) {
+            kicks_config_delete(kicks);
+            luaL_error(L, "require: could not create prototype");
+            return 0;
+        }
+
+        lua_pushlightuserdata(L, proto); // push prototype for hash
+        break;
+    }
     default:
         luaL_argerror(L, 1, "require: unknown type");
         return 0;
@@ -96,16 +197,65 @@ int protoscript_load(lua_State* L) {
         return 0;
     }
 
+    // Handles are one past the index of the prototype in the container, so
+    // that a handle of 0 is never valid.
+    size_t handle = proto_container_count(protos);
+    if (proto->type == MINO_PROTO_PIECE) {
+        ((piece_config_t*)proto->data)->proto_handle = handle;
+    }
+
     // At this point, nothing else can go wrong, so we can push our pointer
     // into proto_hash without worrying that it doesn't work.
-    lua_setfield(L, -3, name);
+    lua_setfield(L, -2, name);
 
-    return 0;
+    lua_pushinteger(L, (lua_Integer)handle);
+    return 1;
+}
+
+/**
+ * Lua: Get the handle of a loaded prototype by name.
+ *
+ * Returns nil if there is no prototype with that name.
+ */
+static int protoscript_get(lua_State* L) {
+    // Parameter 1: prototype name
+    const char* name = luaL_checkstring(L, 1);
+
+    // Internal State 1: protos table
+    int type = lua_getfield(L, lua_upvalueindex(1), "proto_hash");
+    if (type != LUA_TTABLE) {
+        luaL_error(L, "missing internal state (proto_hash)");
+        return 0;
+    }
+
+    // Internal State 2: protos container
+    proto_container_t* protos = script_to_context(L)->protos;
+
+    lua_getfield(L, -1, name); // push prototype
+    proto_t* proto = lua_touserdata(L, -1);
+    if (proto == NULL) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // Prototypes are only ever looked up by name at load time, so a linear
+    // search is fine here.
+    size_t count = proto_container_count(protos);
+    for (size_t i = 0;i < count;i++) {
+        if (proto_container_get(protos, i) == proto) {
+            lua_pushinteger(L, (lua_Integer)(i + 1));
+            return 1;
+        }
+    }
+
+    lua_pushnil(L);
+    return 1;
 }
 
 int protoscript_openlib(lua_State* L) {
     static const luaL_Reg protolib[] = {
         { "load", protoscript_load },
+        { "get", protoscript_get },
         { NULL, NULL }
     };
 
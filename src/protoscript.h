@@ -17,7 +17,10 @@
 
 #pragma once
 
+#include "proto.h"
+
 // Forward declarations.
 typedef struct lua_State lua_State;
 
+proto_t* protoscript_check_proto(lua_State* L, int arg, proto_type_t type);
 int protoscript_openlib(lua_State* L);
@@ -64,9 +64,8 @@ static uint32_t random_next(random_t* random) {
  *       libc rand as a fallback.
  */
 random_t* random_new(uint32_t* seed) {
-    random_t* random = calloc(1, sizeof(random_t));
+    random_t* random = entity_pool_alloc(MINO_ENTITY_RANDOM, sizeof(random_t));
     if (random == NULL) {
-        error_push_allocerr();
         goto fail;
     }
 
@@ -97,7 +96,7 @@ void random_delete(random_t* random) {
         return;
     }
 
-    free(random);
+    entity_pool_free(MINO_ENTITY_RANDOM, random);
 }
 
 /**
@@ -132,8 +131,7 @@ void random_serialize(random_t* random, mpack_writer_t* writer) {
 random_t* random_unserialize(serialize_t* ser, mpack_reader_t* reader) {
     random_t* random = NULL;
 
-    if ((random = calloc(1, sizeof(*random))) == NULL) {
-        error_push_allocerr();
+    if ((random = entity_pool_alloc(MINO_ENTITY_RANDOM, sizeof(*random))) == NULL) {
         goto fail;
     }
 
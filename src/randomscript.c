@@ -34,12 +34,7 @@ static int randomscript_create(lua_State* L) {
     luaL_argcheck(L, (seed_type == LUA_TNUMBER || seed_type == LUA_TNIL), 1, "invalid seed");
 
     // Internal State 1: Entity manager
-    int type = lua_getfield(L, lua_upvalueindex(1), "entity_manager");
-    if (type != LUA_TLIGHTUSERDATA) {
-        luaL_error(L, "missing internal state (entity_manager)");
-        return 0;
-    }
-    entity_manager_t* manager = lua_touserdata(L, -1);
+    entity_manager_t* manager = script_to_context(L)->entities;
 
     // Allocate the entity
     entity_t* entity = entity_manager_create(manager);
@@ -0,0 +1,572 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rules.h"
+
+#include <stdlib.h>
+
+#include "lua.h"
+#include "mpack.h"
+
+#include "board.h"
+#include "entity.h"
+#include "error.h"
+#include "kicks.h"
+#include "piece.h"
+#include "serialize.h"
+
+/**
+ * Fill a rules configuration with the standard values.
+ */
+void rules_config_init(rules_config_t* config) {
+    config->das = 12;
+    config->arr = 2;
+    config->lock_delay = 30;
+    config->softdrop = 20;
+    config->harddrop = RULES_GRAVITY_UNIT * 20;
+    config->piece = 0;
+}
+
+/**
+ * Allocate rules for a board
+ */
+rules_t* rules_new(handle_t board, const rules_config_t* config) {
+    rules_t* rules = entity_pool_alloc(MINO_ENTITY_RULES, sizeof(rules_t));
+    if (rules == NULL) {
+        goto fail;
+    }
+
+    rules->board = board;
+    rules->config = *config;
+
+    return rules;
+
+fail:
+    rules_delete(rules);
+    return NULL;
+}
+
+/**
+ * Free rules
+ */
+void rules_delete(rules_t* rules) {
+    if (rules == NULL) {
+        return;
+    }
+
+    entity_pool_free(MINO_ENTITY_RULES, rules);
+}
+
+/**
+ * Look up the board that the rules are running on.
+ */
+static board_t* rules_get_board(rules_t* rules) {
+    if (rules->manager == NULL) {
+        return NULL;
+    }
+
+    entity_t* entity = entity_manager_get(rules->manager, rules->board);
+    if (entity == NULL || entity->config.type != MINO_ENTITY_BOARD) {
+        return NULL;
+    }
+
+    return entity->data;
+}
+
+/**
+ * Look up the configuration of a piece entity.
+ */
+static const piece_config_t* rules_get_piece_config(rules_t* rules, handle_t handle) {
+    entity_t* entity = entity_manager_get(rules->manager, handle);
+    if (entity == NULL || entity->config.type != MINO_ENTITY_PIECE) {
+        return NULL;
+    }
+
+    return ((piece_t*)entity->data)->config;
+}
+
+/**
+ * Tell the hooks that something happened.
+ */
+static void rules_event(rules_t* rules, const rules_hooks_t* hooks, rules_event_t event, int value) {
+    if (hooks != NULL && hooks->event != NULL) {
+        hooks->event(hooks->data, rules, event, value);
+    }
+}
+
+/**
+ * Spawn a piece into the piece slot of the rules.
+ *
+ * If the spawn position of the piece is blocked, the piece gets one more
+ * chance one cell higher.  Returns false if it didn't fit either way.
+ */
+static bool rules_spawn(rules_t* rules, board_t* board, handle_t handle) {
+    const piece_config_t* config = rules_get_piece_config(rules, handle);
+    if (config == NULL) {
+        return false;
+    }
+
+    vec2i_t pos = config->spawn_pos;
+    if (board_test_piece(board, config, pos, config->spawn_rot) == false) {
+        pos.y -= 1;
+        if (board_test_piece(board, config, pos, config->spawn_rot) == false) {
+            return false;
+        }
+    }
+
+    if (board_set_piece(board, rules->config.piece, handle) == false) {
+        return false;
+    }
+    if (pos.y != config->spawn_pos.y) {
+        // Piece spawns offset from its usual spot.
+        board_get_boardpiece(board, rules->config.piece)->pos = pos;
+        board_update_ghost(board);
+    }
+
+    // A new piece starts gravity over and can be held again.
+    rules->gravity_remain = 0;
+    rules->hold_lock = false;
+
+    return true;
+}
+
+/**
+ * Spawn the next piece from the next piece hook.
+ */
+static bool rules_spawn_next(rules_t* rules, board_t* board, const rules_hooks_t* hooks) {
+    handle_t handle = handle_empty();
+    if (hooks != NULL && hooks->next_piece != NULL) {
+        handle = hooks->next_piece(hooks->data, rules);
+    }
+
+    if (handle == handle_empty() || rules_spawn(rules, board, handle) == false) {
+        rules_event(rules, hooks, RULES_EVENT_SPAWN_FAIL, 0);
+        return false;
+    }
+
+    rules_event(rules, hooks, RULES_EVENT_SPAWN, 1);
+    return true;
+}
+
+/**
+ * Lock the piece where it is and clear any lines it completed.
+ *
+ * The piece is taken off the board, but the next piece doesn't spawn until
+ * the next tic, to ensure gravity isn't screwed up.
+ */
+static void rules_lock(rules_t* rules, board_t* board, const piece_config_t* config,
+                       const boardpiece_t* bpiece, const rules_hooks_t* hooks) {
+    board_lock_piece(board, config, bpiece->pos, bpiece->rot);
+    uint8_t lines = board_clear_lines(board, NULL);
+    board_unset_piece(board, rules->config.piece);
+    rules->lock_tic = 0;
+
+    rules_event(rules, hooks, RULES_EVENT_LOCK, 0);
+    if (lines > 0) {
+        rules_event(rules, hooks, RULES_EVENT_LINES, lines);
+    }
+}
+
+/**
+ * Number of cells a held direction shifts the piece on a given tic, where
+ * tics is how long the direction has been held.
+ */
+static int rules_shift_distance(const rules_t* rules, const board_t* board, uint32_t tics) {
+    if (tics == 0) {
+        // Move immediately.
+        return 1;
+    } else if (tics < (uint32_t)rules->config.das) {
+        return 0;
+    }
+
+    // Waited out the delay.
+    tics -= rules->config.das;
+    if (rules->config.arr <= 0) {
+        return board->config.width;
+    }
+    return (tics % rules->config.arr == 0) ? 1 : 0;
+}
+
+/**
+ * Run the rules for a single tic
+ *
+ * Returns false if the game is over, because a piece had nowhere to spawn.
+ */
+bool rules_frame(rules_t* rules, uint32_t tic, inputs_t inputs, const rules_hooks_t* hooks) {
+    board_t* board = rules_get_board(rules);
+    if (board == NULL) {
+        return false;
+    }
+    size_t index = rules->config.piece;
+
+    // Rotations only happen on the first tic that the input is held.
+    inputs_t pressed = inputs & ~rules->last_inputs;
+    rules->last_inputs = inputs;
+
+    // Get the next piece if we don't have one at this point.
+    if (board_get_boardpiece(board, index) == NULL) {
+        if (rules_spawn_next(rules, board, hooks) == false) {
+            return false;
+        }
+    }
+
+    // Handle hold piece.
+    if ((inputs & INPUT_HOLD) && rules->hold_lock == false) {
+        handle_t held = rules->hold;
+        rules->hold = board_get_boardpiece(board, index)->handle;
+        board_unset_piece(board, index);
+
+        if (held == handle_empty()) {
+            // We have no other held piece, so generate a new one.
+            if (rules_spawn_next(rules, board, hooks) == false) {
+                return false;
+            }
+        } else {
+            // Spawn the held piece.
+            if (rules_spawn(rules, board, held) == false) {
+                rules_event(rules, hooks, RULES_EVENT_SPAWN_FAIL, 0);
+                return false;
+            }
+            rules_event(rules, hooks, RULES_EVENT_SPAWN, 0);
+        }
+
+        // Lock out holding until the next piece.
+        rules->hold_lock = true;
+        rules_event(rules, hooks, RULES_EVENT_HOLD, 0);
+    }
+
+    boardpiece_t* bpiece = board_get_boardpiece(board, index);
+    const piece_config_t* config = rules_get_piece_config(rules, bpiece->handle);
+    if (config == NULL) {
+        return false;
+    }
+
+    // Handle rotation.
+    int drot = 0;
+    if (pressed & INPUT_CCW) {
+        drot -= 1;
+    }
+    if (pressed & INPUT_CW) {
+        drot += 1;
+    }
+    if (pressed & INPUT_180) {
+        drot -= 2;
+    }
+
+    // Single rotations use the wallkicks of the piece, but 180 degree
+    // rotations don't wallkick at all.
+    bool rotated = false;
+    if (drot == 1) {
+        rotated = board_rotate_piece(board, index, MINO_ROTATE_CW);
+    } else if (drot == -1) {
+        rotated = board_rotate_piece(board, index, MINO_ROTATE_CCW);
+    } else if (drot != 0) {
+        int count = config->data_count;
+        uint8_t rot = (uint8_t)(((bpiece->rot + drot) % count + count) % count);
+        if (board_test_piece(board, config, bpiece->pos, rot)) {
+            bpiece->rot = rot;
+            board_update_ghost(board);
+            rotated = true;
+        }
+    }
+
+    if (rotated) {
+        rules_event(rules, hooks, RULES_EVENT_ROTATE, 0);
+
+        // Rotating the piece successfully resets our lock timer.
+        if (rules->lock_tic != 0) {
+            rules->lock_tic = tic;
+            rules_event(rules, hooks, RULES_EVENT_STEP, 0);
+        }
+    }
+
+    // Handle movement.
+    //
+    // Here we track the tic that each direction started being held on.  We
+    // use this to track DAS and to also ensure that pressing both directions
+    // at once in a staggered way behaves correctly.
+    if (inputs & INPUT_LEFT) {
+        if (rules->left_tic == 0) {
+            rules->left_tic = tic;
+        }
+    } else {
+        rules->left_tic = 0;
+    }
+    if (inputs & INPUT_RIGHT) {
+        if (rules->right_tic == 0) {
+            rules->right_tic = tic;
+        }
+    } else {
+        rules->right_tic = 0;
+    }
+
+    int dx = 0;
+    if (rules->left_tic > rules->right_tic) {
+        // Ignore right, the newer direction wins.
+        dx = -rules_shift_distance(rules, board, tic - rules->left_tic);
+    } else if (rules->left_tic < rules->right_tic) {
+        // Ignore left, the newer direction wins.
+        dx = rules_shift_distance(rules, board, tic - rules->right_tic);
+    }
+
+    if (dx != 0) {
+        vec2i_t dst = bpiece->pos;
+        dst.x += dx;
+        vec2i_t pos = board_test_piece_between(board, config, bpiece->pos, bpiece->rot, dst);
+        if (pos.x != bpiece->pos.x) {
+            bpiece->pos = pos;
+            board_update_ghost(board);
+            rules_event(rules, hooks, RULES_EVENT_MOVE, 0);
+
+            // Moving the piece successfully resets our lock timer.
+            if (rules->lock_tic != 0) {
+                rules->lock_tic = tic;
+                rules_event(rules, hooks, RULES_EVENT_STEP, 0);
+            }
+        }
+    }
+
+    // Is our piece blocked from the bottom?  If so, lock logic takes priority
+    // over gravity logic.
+    vec2i_t below = bpiece->pos;
+    below.y += 1;
+    if (board_test_piece(board, config, below, bpiece->rot) == false) {
+        if (rules->lock_tic == 0) {
+            // This is our first tic that we've locked.
+            rules->lock_tic = tic;
+            rules_event(rules, hooks, RULES_EVENT_STEP, 0);
+        }
+
+        if (tic - rules->lock_tic >= (uint32_t)rules->config.lock_delay) {
+            // Our lock timer has run out, lock the piece.  Piece lock is
+            // mutually exclusive with any other piece movement this tic.
+            rules_lock(rules, board, config, bpiece, hooks);
+            return true;
+        }
+    } else {
+        // We are not in lock logic anymore.
+        rules->lock_tic = 0;
+    }
+
+    // Soft dropping and hard dropping aren't anything too special, they
+    // just toy with gravity.
+    int64_t gravity = rules->gravity;
+    if (inputs & INPUT_SOFTDROP) {
+        gravity *= rules->config.softdrop;
+    }
+
+    // If you press soft and hard drop at the same time, hard drop wins.
+    // If you hold hard drop and press soft drop afterwards, soft drop wins.
+    if (inputs & INPUT_HARDDROP) {
+        if (rules->harddrop_tic == 0) {
+            // We only pay attention to hard drops on the tic they were
+            // invoked.  Othewise, you have rapid-fire dropping or even
+            // pieces running into each other at the top of the well.
+            gravity = rules->config.harddrop;
+            rules->harddrop_tic = tic;
+        }
+    } else {
+        rules->harddrop_tic = 0;
+    }
+
+    // Based on our gravity, how many cells does the piece travel this tic?
+    gravity += rules->gravity_remain;
+    int64_t cells = gravity / RULES_GRAVITY_UNIT;
+    rules->gravity_remain = (int32_t)(gravity % RULES_GRAVITY_UNIT);
+
+    if (cells > 0) {
+        // The piece can never fall further than the height of the board.
+        vec2i_t dst = bpiece->pos;
+        dst.y += (cells < board->config.height) ? (int)cells : board->config.height;
+
+        // Our new location is always wherever the test tells us.  If we
+        // can't move down, we're relying on our lock delay logic to handle
+        // things next tic.
+        vec2i_t pos = board_test_piece_between(board, config, bpiece->pos, bpiece->rot, dst);
+        if (pos.y != bpiece->pos.y) {
+            bpiece->pos = pos;
+            board_update_ghost(board);
+        }
+
+        if (rules->harddrop_tic == tic) {
+            // ...unless our gravity was actually a hard drop.  In that case,
+            // lock the piece immediately.
+            rules_lock(rules, board, config, bpiece, hooks);
+            return true;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Serialize rules struct using msgpack
+ */
+void rules_serialize(rules_t* rules, mpack_writer_t* writer) {
+    mpack_start_array(writer, 13);
+    mpack_write_u64(writer, rules->board);
+
+    mpack_start_array(writer, 6);
+    mpack_write_i16(writer, rules->config.das);
+    mpack_write_i16(writer, rules->config.arr);
+    mpack_write_i16(writer, rules->config.lock_delay);
+    mpack_write_i16(writer, rules->config.softdrop);
+    mpack_write_i32(writer, rules->config.harddrop);
+    mpack_write_u8(writer, rules->config.piece);
+    mpack_finish_array(writer);
+
+    mpack_write_i32(writer, rules->gravity);
+    mpack_write_i32(writer, rules->gravity_remain);
+    mpack_write_u32(writer, rules->left_tic);
+    mpack_write_u32(writer, rules->right_tic);
+    mpack_write_u32(writer, rules->lock_tic);
+    mpack_write_u32(writer, rules->harddrop_tic);
+    mpack_write_u8(writer, rules->last_inputs);
+    mpack_write_u64(writer, rules->hold);
+    mpack_write_bool(writer, rules->hold_lock);
+    mpack_finish_array(writer);
+}
+
+/**
+ * Unserialize rules struct using msgpack
+ *
+ * The rules aren't attached to an entity manager, so the caller has to
+ * supply one before the board can be looked up.
+ */
+rules_t* rules_unserialize(mpack_reader_t* reader) {
+    rules_t* rules = NULL;
+
+    mpack_expect_array_match(reader, 13);
+    handle_t board = mpack_expect_u64(reader);
+
+    rules_config_t config;
+    mpack_expect_array_match(reader, 6);
+    config.das = mpack_expect_i16(reader);
+    config.arr = mpack_expect_i16(reader);
+    config.lock_delay = mpack_expect_i16(reader);
+    config.softdrop = mpack_expect_i16(reader);
+    config.harddrop = mpack_expect_i32(reader);
+    config.piece = mpack_expect_u8_max(reader, MAX_BOARD_PIECES - 1);
+    mpack_done_array(reader);
+    if (mpack_reader_error(reader) != mpack_ok) {
+        error_push("Rules configuration is invalid.");
+        goto fail;
+    }
+
+    if ((rules = rules_new(board, &config)) == NULL) {
+        goto fail;
+    }
+
+    rules->gravity = mpack_expect_i32(reader);
+    rules->gravity_remain = mpack_expect_i32_range(reader, 0, RULES_GRAVITY_UNIT - 1);
+    rules->left_tic = mpack_expect_u32(reader);
+    rules->right_tic = mpack_expect_u32(reader);
+    rules->lock_tic = mpack_expect_u32(reader);
+    rules->harddrop_tic = mpack_expect_u32(reader);
+    rules->last_inputs = mpack_expect_u8(reader);
+    rules->hold = mpack_expect_u64(reader);
+    rules->hold_lock = mpack_expect_bool(reader);
+    mpack_done_array(reader);
+
+    if (mpack_reader_error(reader) != mpack_ok) {
+        error_push("Rules are invalid.");
+        goto fail;
+    }
+
+    return rules;
+
+fail:
+    rules_delete(rules);
+    return NULL;
+}
+
+/**
+ * Wrap serialize with void* function.
+ */
+static void wrapserialize(void* ptr, mpack_writer_t* writer) {
+    rules_serialize(ptr, writer);
+}
+
+/**
+ * Wrap delete with void* function.
+ */
+static void wrapdelete(void* ptr) {
+    rules_delete(ptr);
+}
+
+/**
+ * Attach rules to an entity.
+ */
+static void rules_entity_attach(entity_t* entity, entity_manager_t* manager, rules_t* rules) {
+    rules->manager = manager;
+
+    entity->config.type = MINO_ENTITY_RULES;
+    entity->config.serialize = wrapserialize;
+    entity->config.destruct = wrapdelete;
+    entity->data = rules;
+}
+
+/**
+ * Initialize an entity with rules for a board
+ */
+bool rules_entity_init(entity_t* entity, entity_manager_t* manager, handle_t board,
+                       const rules_config_t* config) {
+    rules_t* rules = rules_new(board, config);
+    if (rules == NULL) {
+        return false;
+    }
+
+    rules_entity_attach(entity, manager, rules);
+    return true;
+}
+
+/**
+ * Initialize an entity with serialized rules
+ *
+ * The rules are attached to the entity manager in the registry, so the
+ * board and pieces can be looked up again.
+ */
+bool rules_entity_unserialize(entity_t* entity, serialize_t* ser, mpack_reader_t* reader) {
+    int top = lua_gettop(ser->lua);
+    rules_t* rules = NULL;
+
+    // push registry table
+    if (lua_rawgeti(ser->lua, LUA_REGISTRYINDEX, ser->registry_ref) != LUA_TTABLE) {
+        error_push("Registry reference is stale.");
+        goto fail;
+    }
+
+    // push entity manager
+    if (lua_getfield(ser->lua, -1, "entity_manager") != LUA_TLIGHTUSERDATA) {
+        error_push("Entity manager is missing from registry.");
+        goto fail;
+    }
+    entity_manager_t* manager = lua_touserdata(ser->lua, -1);
+
+    if ((rules = rules_unserialize(reader)) == NULL) {
+        goto fail;
+    }
+
+    rules_entity_attach(entity, manager, rules);
+
+    lua_settop(ser->lua, top);
+    return true;
+
+fail:
+    lua_settop(ser->lua, top);
+    return false;
+}
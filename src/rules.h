@@ -0,0 +1,220 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "define.h"
+
+#include "input.h"
+
+// Forward declarations.
+typedef struct entity_s entity_t;
+typedef struct entity_manager_s entity_manager_t;
+typedef struct mpack_reader_t mpack_reader_t;
+typedef struct mpack_writer_t mpack_writer_t;
+typedef struct rules_s rules_t;
+typedef struct serialize_s serialize_t;
+
+/**
+ * Gravity of one cell per tic.
+ *
+ * Gravity is a 16.16 fixed-point number, so that it comes out the same on
+ * every computer.
+ */
+#define RULES_GRAVITY_UNIT (1 << 16)
+
+/**
+ * Things that can happen to a board while the rules are running.
+ */
+typedef enum {
+    /**
+     * A piece was spawned.  The value is 1 if the piece came from the next
+     * piece hook, or 0 if it came out of hold.
+     */
+    RULES_EVENT_SPAWN,
+
+    /**
+     * There was no room to spawn a piece.  The game is over.
+     */
+    RULES_EVENT_SPAWN_FAIL,
+
+    /**
+     * The piece was moved sideways.
+     */
+    RULES_EVENT_MOVE,
+
+    /**
+     * The piece was rotated.
+     */
+    RULES_EVENT_ROTATE,
+
+    /**
+     * The piece touched the stack, or was moved while touching it.
+     */
+    RULES_EVENT_STEP,
+
+    /**
+     * The piece was put into hold.
+     */
+    RULES_EVENT_HOLD,
+
+    /**
+     * The piece was locked onto the board.
+     */
+    RULES_EVENT_LOCK,
+
+    /**
+     * Lines were cleared.  The value is the number of lines.
+     */
+    RULES_EVENT_LINES,
+    RULES_EVENT_MAX
+} rules_event_t;
+
+/**
+ * Callbacks that the rules use to talk to whoever is running them.
+ */
+typedef struct {
+    /**
+     * Return the handle of the piece to spawn next, or an empty handle if
+     * there isn't one.  The piece is only taken off the queue when the
+     * spawn event with a value of 1 comes afterwards.
+     */
+    handle_t (*next_piece)(void* data, rules_t* rules);
+
+    /**
+     * Called for every event.  Can be NULL.
+     */
+    void (*event)(void* data, rules_t* rules, rules_event_t event, int value);
+
+    /**
+     * Passed to every callback.
+     */
+    void* data;
+} rules_hooks_t;
+
+/**
+ * Tunable values of the rules.
+ */
+typedef struct {
+    /**
+     * Number of tics that left or right has to be held before the piece
+     * starts to shift on its own.
+     */
+    int16_t das;
+
+    /**
+     * Number of tics between every automatic shift, or 0 to shift all the
+     * way to the wall at once.
+     */
+    int16_t arr;
+
+    /**
+     * Number of tics that a piece can rest on the stack before it locks.
+     */
+    int16_t lock_delay;
+
+    /**
+     * Multiplier of gravity while soft drop is held.
+     */
+    int16_t softdrop;
+
+    /**
+     * Gravity of a hard drop.
+     */
+    int32_t harddrop;
+
+    /**
+     * Index of the board piece that the rules control.
+     */
+    uint8_t piece;
+} rules_config_t;
+
+/**
+ * Per-tic rules of a single board.
+ */
+typedef struct rules_s {
+    /**
+     * Entity manager
+     *
+     * Necessary for looking up the board and piece handles.  This is not an
+     * owning pointer, so don't free it.
+     */
+    entity_manager_t* manager;
+
+    /**
+     * Board entity handle.
+     */
+    handle_t board;
+
+    /**
+     * Configuration of the rules.
+     */
+    rules_config_t config;
+
+    /**
+     * Gravity of the piece when nothing is held down.
+     */
+    int32_t gravity;
+
+    /**
+     * Leftover gravity from the last tic, always less than one cell.
+     */
+    int32_t gravity_remain;
+
+    /**
+     * Tic that left and right began on.  Set to 0 if released.
+     */
+    uint32_t left_tic;
+    uint32_t right_tic;
+
+    /**
+     * Tic that lock delay started on.  Set to 0 if lock delay isn't in
+     * effect.
+     */
+    uint32_t lock_tic;
+
+    /**
+     * Tic that hard drop began on.  Set to 0 if released.
+     */
+    uint32_t harddrop_tic;
+
+    /**
+     * Inputs of the last tic, so rotations only happen on the first tic
+     * that the input is held.
+     */
+    inputs_t last_inputs;
+
+    /**
+     * Piece entity handle of the hold piece, or an empty handle.
+     */
+    handle_t hold;
+
+    /**
+     * True if the hold piece can't be used until the next piece spawns.
+     */
+    bool hold_lock;
+} rules_t;
+
+void rules_config_init(rules_config_t* config);
+rules_t* rules_new(handle_t board, const rules_config_t* config);
+void rules_delete(rules_t* rules);
+bool rules_frame(rules_t* rules, uint32_t tic, inputs_t inputs, const rules_hooks_t* hooks);
+void rules_serialize(rules_t* rules, mpack_writer_t* writer);
+rules_t* rules_unserialize(mpack_reader_t* reader);
+bool rules_entity_init(entity_t* entity, entity_manager_t* manager, handle_t board,
+                       const rules_config_t* config);
+bool rules_entity_unserialize(entity_t* entity, serialize_t* ser, mpack_reader_t* reader);
@@ -0,0 +1,283 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "lauxlib.h"
+
+#include "board.h"
+#include "entity.h"
+#include "entityscript.h"
+#include "inputscript.h"
+#include "rules.h"
+#include "script.h"
+
+/**
+ * Names of the hooks that are called for every rules event.
+ */
+static const char* rulesscript_events[RULES_EVENT_MAX] = {
+    "spawn", "spawn_failed", "move", "rotate", "step", "hold", "lock", "lines"
+};
+
+/**
+ * Where the hooks of a call to frame live on the Lua stack.
+ */
+typedef struct {
+    lua_State* L;
+
+    /**
+     * Stack index of the hooks table.
+     */
+    int hooks;
+
+    /**
+     * Stack index of the value that is passed to every hook.
+     */
+    int arg;
+} rulesscript_hooks_t;
+
+/**
+ * Read an optional integer field of a configuration table.
+ */
+static lua_Integer rulesscript_opt_field(lua_State* L, int index, const char* name,
+                                         lua_Integer def, lua_Integer min, lua_Integer max) {
+    lua_Integer value = def;
+    if (lua_getfield(L, index, name) != LUA_TNIL) {
+        if (lua_isinteger(L, -1) == 0) {
+            luaL_error(L, "rules \"%s\" is not an integer", name);
+            return 0;
+        }
+        value = lua_tointeger(L, -1);
+    }
+    lua_pop(L, 1); // pop field
+
+    if (value < min || value > max) {
+        luaL_error(L, "rules \"%s\" is out of range", name);
+        return 0;
+    }
+
+    return value;
+}
+
+/**
+ * Next piece hook that calls into Lua.
+ */
+static handle_t rulesscript_next_piece(void* data, rules_t* rules) {
+    (void)rules;
+    rulesscript_hooks_t* hooks = data;
+    lua_State* L = hooks->L;
+
+    if (lua_getfield(L, hooks->hooks, "next_piece") != LUA_TFUNCTION) {
+        luaL_error(L, "rules hooks have no next_piece function");
+        return handle_empty();
+    }
+    lua_pushvalue(L, hooks->arg);
+    lua_call(L, 1, 1);
+
+    if (lua_isnil(L, -1)) {
+        // Out of pieces.
+        lua_pop(L, 1);
+        return handle_empty();
+    }
+
+    handle_t* id = luaL_testudata(L, -1, "handle_t");
+    if (id == NULL) {
+        luaL_error(L, "next_piece hook did not return a piece");
+        return handle_empty();
+    }
+    handle_t handle = *id;
+    lua_pop(L, 1); // pop piece
+
+    return handle;
+}
+
+/**
+ * Event hook that calls into Lua.
+ *
+ * Events without a hook are ignored.
+ */
+static void rulesscript_event(void* data, rules_t* rules, rules_event_t event, int value) {
+    (void)rules;
+    rulesscript_hooks_t* hooks = data;
+    lua_State* L = hooks->L;
+
+    if (lua_getfield(L, hooks->hooks, rulesscript_events[event]) != LUA_TFUNCTION) {
+        lua_pop(L, 1);
+        return;
+    }
+    lua_pushvalue(L, hooks->arg);
+    lua_pushinteger(L, value);
+    lua_call(L, 2, 0);
+}
+
+/**
+ * Lua: Initialize new rules for a board.
+ */
+static int rulesscript_create(lua_State* L) {
+    // Parameter 1: Board handle
+    entity_t* board = entityscript_to_entity(L, 1, MINO_ENTITY_BOARD);
+
+    // Parameter 2: Configuration table, optional
+    rules_config_t config;
+    rules_config_init(&config);
+    lua_Integer gravity = 0;
+    if (lua_isnoneornil(L, 2) == 0) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        config.das = (int16_t)rulesscript_opt_field(L, 2, "das", config.das, 0, INT16_MAX);
+        config.arr = (int16_t)rulesscript_opt_field(L, 2, "arr", config.arr, 0, INT16_MAX);
+        config.lock_delay = (int16_t)rulesscript_opt_field(L, 2, "lock_delay", config.lock_delay,
+                                                           0, INT16_MAX);
+        config.softdrop = (int16_t)rulesscript_opt_field(L, 2, "softdrop", config.softdrop,
+                                                         1, INT16_MAX);
+        config.harddrop = (int32_t)rulesscript_opt_field(L, 2, "harddrop", config.harddrop,
+                                                         0, INT32_MAX);
+        config.piece = (uint8_t)(rulesscript_opt_field(L, 2, "piece", config.piece + 1,
+                                                        1, MAX_BOARD_PIECES) - 1);
+        gravity = rulesscript_opt_field(L, 2, "gravity", 0, 0, INT32_MAX);
+    }
+
+    // Internal State 1: Entity manager
+    entity_manager_t* manager = script_to_context(L)->entities;
+
+    // Allocate the entity
+    entity_t* entity = entity_manager_create(manager);
+    if (entity == NULL) {
+        luaL_error(L, "could not allocate new entity");
+        return 0;
+    }
+
+    // Initialize the entity with the rules
+    bool ok = rules_entity_init(entity, manager, board->id, &config);
+    if (ok == false) {
+        luaL_error(L, "could not initialize entity");
+        return 0;
+    }
+    ((rules_t*)entity->data)->gravity = (int32_t)gravity;
+
+    // Allocate a handle for our entity
+    handle_t* id = lua_newuserdata(L, sizeof(handle_t));
+    *id = entity->id;
+
+    // Designate as an entity handle
+    luaL_setmetatable(L, "handle_t");
+    return 1;
+}
+
+/**
+ * Lua: Run the rules for a single tic.
+ *
+ * The hooks table holds a next_piece function, which is called whenever a
+ * piece needs to spawn, and a function for every event that should be
+ * handled.  The last parameter is passed along to every hook.
+ *
+ * Returns false if the game is over.
+ */
+static int rulesscript_frame(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_RULES);
+    rules_t* rules = entity->data;
+
+    // Parameter 2: Gametic
+    lua_Integer tic = luaL_checkinteger(L, 2);
+
+    // Parameter 3: Player inputs
+    inputscript_inputs_t* inputs = luaL_checkudata(L, 3, "inputs_t");
+
+    // Parameter 4: Player number, 1-indexed.
+    lua_Integer player = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, (player >= 1 && player <= MINO_MAX_PLAYERS), 4, "invalid player index");
+
+    // Parameter 5: Hooks table
+    luaL_checktype(L, 5, LUA_TTABLE);
+
+    // Parameter 6: Hook argument, optional
+    lua_settop(L, 6);
+
+    rulesscript_hooks_t data = { L, 5, 6 };
+    rules_hooks_t hooks = { rulesscript_next_piece, rulesscript_event, &data };
+
+    bool ok = rules_frame(rules, (uint32_t)tic, inputs->current.inputs[player - 1], &hooks);
+    lua_pushboolean(L, ok);
+    return 1;
+}
+
+/**
+ * Lua: Get the gravity of the rules.
+ */
+static int rulesscript_get_gravity(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_RULES);
+    rules_t* rules = entity->data;
+
+    lua_pushinteger(L, rules->gravity);
+    return 1;
+}
+
+/**
+ * Lua: Set the gravity of the rules, as a 16.16 fixed-point number.
+ */
+static int rulesscript_set_gravity(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_RULES);
+    rules_t* rules = entity->data;
+
+    // Parameter 2: Gravity
+    lua_Integer gravity = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (gravity >= 0 && gravity <= INT32_MAX), 2, "invalid gravity");
+
+    rules->gravity = (int32_t)gravity;
+    return 0;
+}
+
+/**
+ * Lua: Get the hold piece of the rules, or nil if there isn't one.
+ */
+static int rulesscript_get_hold(lua_State* L) {
+    // Parameter 1: Our userdata
+    entity_t* entity = entityscript_to_entity(L, 1, MINO_ENTITY_RULES);
+    rules_t* rules = entity->data;
+
+    if (rules->hold == handle_empty()) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    handle_t* id = lua_newuserdata(L, sizeof(handle_t));
+    *id = rules->hold;
+
+    // Designate as an entity handle
+    luaL_setmetatable(L, "handle_t");
+    return 1;
+}
+
+/**
+ * Initialize the rules module.
+ */
+int rulesscript_openlib(lua_State* L) {
+    static const luaL_Reg ruleslib[] = {
+        { "create", rulesscript_create },
+        { "frame", rulesscript_frame },
+        { "get_gravity", rulesscript_get_gravity },
+        { "set_gravity", rulesscript_set_gravity },
+        { "get_hold", rulesscript_get_hold },
+        { NULL, NULL }
+    };
+
+    luaL_newlib(L, ruleslib);
+
+    lua_pushinteger(L, RULES_GRAVITY_UNIT);
+    lua_setfield(L, -2, "GRAVITY_UNIT");
+    return 1;
+}
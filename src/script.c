@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lua.h"
 #include "lualib.h"
@@ -32,23 +33,55 @@
 #include "globalscript.h"
 #include "piece.h"
 #include "piecescript.h"
+#include "platform.h"
 #include "protoscript.h"
 #include "random.h"
 #include "randomscript.h"
 #include "renderscript.h"
+#include "rulesscript.h"
+#include "scriptalloc.h"
 #include "vfs.h"
 
+/**
+ * Registry key of the garbage collection schedule of a state.  Only the
+ * address matters.
+ */
+static const char g_gc_key = 0;
+
+/**
+ * Report an error that happened outside of any protected call
+ */
+static int script_panic(lua_State* L) {
+    fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+    return 0; // return to Lua to abort
+}
+
 /**
  * Create a lua state that contains all of our libraries
+ *
+ * The state allocates through a pooled allocator, so it must be closed with
+ * script_closestate.
  */
 lua_State* script_newstate(void) {
     lua_State* L = NULL;
+    scriptalloc_t* alloc = NULL;
+
+    if ((alloc = scriptalloc_new()) == NULL) {
+        return NULL;
+    }
 
     // Create a new Lua state
-    if ((L = luaL_newstate()) == NULL) {
+    if ((L = lua_newstate(scriptalloc_alloc, alloc)) == NULL) {
         error_push_allocerr();
+        scriptalloc_delete(alloc);
         return NULL;
     }
+    lua_atpanic(L, script_panic);
+
+    // Everything that collects garbage by hand shares one schedule.
+    script_gc_t* gc = lua_newuserdata(L, sizeof(script_gc_t));
+    memset(gc, 0x00, sizeof(*gc));
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &g_gc_key);
 
     static const luaL_Reg loadedlibs[] = {
         { "_G", globalscript_openlib },
@@ -59,6 +92,7 @@ lua_State* script_newstate(void) {
         { "mino_proto", protoscript_openlib },
         { "mino_random", randomscript_openlib },
         { "mino_render", renderscript_openlib },
+        { "mino_rules", rulesscript_openlib },
         { LUA_MATHLIBNAME, luaopen_math },
         { LUA_STRLIBNAME, luaopen_string },
         { LUA_TABLIBNAME, luaopen_table },
@@ -74,6 +108,109 @@ lua_State* script_newstate(void) {
     return L;
 }
 
+/**
+ * Close a lua state created by script_newstate
+ */
+void script_closestate(lua_State* L) {
+    if (L == NULL) {
+        return;
+    }
+
+    scriptalloc_t* alloc = scriptalloc_from_state(L);
+    lua_close(L);
+    scriptalloc_delete(alloc);
+}
+
+/**
+ * Stop the garbage collector from running on its own
+ *
+ * Returns true if the collector was running, which needs to be handed back
+ * to script_gc_restart.
+ */
+bool script_gc_stop(lua_State* L) {
+    bool running = lua_gc(L, LUA_GCISRUNNING, 0) != 0;
+    if (running) {
+        lua_gc(L, LUA_GCSTOP, 0);
+    }
+
+    return running;
+}
+
+/**
+ * Let the garbage collector run on its own again, if it was running before
+ * script_gc_stop
+ */
+void script_gc_restart(lua_State* L, bool running) {
+    if (running) {
+        lua_gc(L, LUA_GCRESTART, 0);
+    }
+}
+
+/**
+ * Get the schedule of the garbage collection that we run by hand
+ */
+script_gc_t* script_get_gc(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &g_gc_key);
+    script_gc_t* gc = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return gc;
+}
+
+/**
+ * Step the garbage collector by hand for up to the given number of
+ * milliseconds
+ *
+ * Steps are small, so this can go over the budget by about one step.  Once a
+ * cycle finishes, we don't start another one until the heap has doubled
+ * since, the same as the default pause of the collector.
+ */
+void script_gc_step(lua_State* L, script_gc_t* gc, double budget_ms) {
+    int heap = lua_gc(L, LUA_GCCOUNT, 0);
+    if (gc->cycling == false && heap < gc->threshold) {
+        gc->heap = heap;
+        return;
+    }
+
+    double start = platform()->clock_ms();
+    double elapsed = 0.0;
+    gc->cycling = true;
+    while (elapsed < budget_ms) {
+        gc->steps += 1;
+        bool finished = lua_gc(L, LUA_GCSTEP, 0) != 0;
+        elapsed = platform()->clock_ms() - start;
+
+        if (finished) {
+            gc->cycling = false;
+            gc->cycles += 1;
+            gc->threshold = lua_gc(L, LUA_GCCOUNT, 0) * 2;
+            break;
+        }
+    }
+
+    gc->heap = lua_gc(L, LUA_GCCOUNT, 0);
+    gc->collections += 1;
+    gc->last_ms = elapsed;
+    gc->total_ms += elapsed;
+    if (elapsed > gc->longest_ms) {
+        gc->longest_ms = elapsed;
+    }
+}
+
+/**
+ * Get the native context of the running C function.
+ *
+ * Raises a Lua error if the function was never wrapped with a context.
+ */
+script_context_t* script_to_context(lua_State* L) {
+    script_context_t* context = lua_touserdata(L, lua_upvalueindex(2));
+    if (context == NULL) {
+        luaL_error(L, "missing internal state (context)");
+        return NULL;
+    }
+
+    return context;
+}
+
 /**
  * Turn the table at the given stack index into a vector.
  */
@@ -96,16 +233,38 @@ bool script_to_vector(lua_State* L, int index, vec2i_t* vec) {
  * Push a table to the stack with the contents of the given vector.
  */
 void script_push_vector(lua_State* L, const vec2i_t* vec) {
-    lua_createtable(L, 2, 0);
+    lua_createtable(L, 0, 2);
     lua_pushinteger(L, vec->x);
     lua_setfield(L, -2, "x");
     lua_pushinteger(L, vec->y);
     lua_setfield(L, -2, "y");
 }
 
+/**
+ * Turn the pair of integers at the given stack index into a vector.
+ *
+ * The x coordinate is at the index and the y coordinate is right after it.
+ * Unlike a vector table, this doesn't need anything from the Lua heap.
+ * Raises a Lua error if either of them isn't an integer.
+ */
+vec2i_t script_check_xy(lua_State* L, int index) {
+    vec2i_t vec;
+    vec.x = (int)luaL_checkinteger(L, index);
+    vec.y = (int)luaL_checkinteger(L, index + 1);
+    return vec;
+}
+
+/**
+ * Push the contents of the given vector to the stack as two integers.
+ */
+void script_push_xy(lua_State* L, const vec2i_t* vec) {
+    lua_pushinteger(L, vec->x);
+    lua_pushinteger(L, vec->y);
+}
+
 /**
  * Recursively wrap all cfunctions with closures containing the given index
- * as a first upvalue
+ * as a first upvalue, and the "context" member of it as a second upvalue
  *
  * Pops the unwrapped item from the top of the stack and pushes a wrapped
  * version of the item.  If the item didn't need to be wrapped, nothing
@@ -134,7 +293,8 @@ void script_wrap_cfuncs(lua_State* L, int index) {
         if (func != NULL) {
             lua_pop(L, 1); // pop cfunction
             lua_pushvalue(L, index); // push registry
-            lua_pushcclosure(L, func, 1); // pop registry, push closure
+            lua_getfield(L, index, "context"); // push context
+            lua_pushcclosure(L, func, 2); // pop registry and context, push closure
         }
         break;
     }
@@ -144,6 +304,30 @@ void script_wrap_cfuncs(lua_State* L, int index) {
     }
 }
 
+/**
+ * Turn a script file into a runnable chunk and push it to the stack, or
+ * push an error message if the script could not be compiled
+ *
+ * If the resource pack that the script came from is trusted and carries a
+ * precompiled version of it, that is loaded instead of compiling the source.
+ * Chunks that were compiled by a different build of Lua fail to load, and
+ * fall back to the source.  Returns a Lua status code.
+ */
+int script_load_chunk(lua_State* L, const vfile_t* file) {
+    vfile_t* compiled = vfs_vfile_new_compiled(file->filename);
+    if (compiled != NULL) {
+        int status = luaL_loadbufferx(L, (char*)compiled->data, compiled->size,
+                                      file->filename, "b");
+        vfs_vfile_delete(compiled);
+        if (status == LUA_OK) {
+            return LUA_OK;
+        }
+        lua_pop(L, 1); // pop error
+    }
+
+    return luaL_loadbufferx(L, (char*)file->data, file->size, file->filename, "t");
+}
+
 /**
  * Take a configuration file and push a table that contains all defined
  * configuration values to the stack, or an error message if there was a
@@ -154,7 +338,7 @@ void script_wrap_cfuncs(lua_State* L, int index) {
  */
 bool script_load_config(lua_State* L, vfile_t* file) {
     // Load the file into Lua as a chunk.
-    if (luaL_loadbufferx(L, (char*)file->data, file->size, file->filename, "t") != LUA_OK) {
+    if (script_load_chunk(L, file) != LUA_OK) {
         // We have an error on the stack, just return it.
         return false;
     }
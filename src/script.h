@@ -20,13 +20,98 @@
 #include "define.h"
 
 // Forward declarations.
+typedef struct entity_manager_s entity_manager_t;
 typedef struct lua_State lua_State;
+typedef struct proto_container_s proto_container_t;
 typedef struct vfile_s vfile_t;
 
+/**
+ * Native state of a script environment.
+ *
+ * Every wrapped C function gets a pointer to this as its second upvalue, so
+ * bindings can get at it directly instead of looking it up by name in the
+ * registry table on every call.
+ */
+typedef struct script_context_s {
+    /**
+     * Entities of the environment.
+     *
+     * This is not an owning pointer, so don't free it.
+     */
+    entity_manager_t* entities;
+
+    /**
+     * Prototypes of the environment.
+     *
+     * This is not an owning pointer, so don't free it.
+     */
+    proto_container_t* protos;
+} script_context_t;
+
+/**
+ * Schedule of the garbage collection that we run by hand between frames,
+ * along with how long it has been pausing the game for.
+ */
+typedef struct script_gc_s {
+    /**
+     * True if we are in the middle of a collection cycle.
+     */
+    bool cycling;
+
+    /**
+     * Size of the heap in kilobytes that starts the next cycle.
+     */
+    int threshold;
+
+    /**
+     * Size of the heap in kilobytes after the last collection.
+     */
+    int heap;
+
+    /**
+     * Number of times the collector has been given time.
+     */
+    uint32_t collections;
+
+    /**
+     * Number of collector steps taken over all collections.
+     */
+    uint32_t steps;
+
+    /**
+     * Number of collection cycles we have finished.
+     */
+    uint32_t cycles;
+
+    /**
+     * Milliseconds spent in the last collection.
+     */
+    double last_ms;
+
+    /**
+     * Milliseconds spent in the longest collection.
+     */
+    double longest_ms;
+
+    /**
+     * Milliseconds spent in every collection added together.
+     */
+    double total_ms;
+} script_gc_t;
+
 lua_State* script_newstate(void);
+void script_closestate(lua_State* L);
+bool script_gc_stop(lua_State* L);
+void script_gc_restart(lua_State* L, bool running);
+script_gc_t* script_get_gc(lua_State* L);
+void script_gc_step(lua_State* L, script_gc_t* gc, double budget_ms);
+script_context_t* script_to_context(lua_State* L);
 bool script_to_vector(lua_State* L, int index, vec2i_t* vec);
 void script_push_vector(lua_State* L, const vec2i_t* vec);
+vec2i_t script_check_xy(lua_State* L, int index);
+void script_push_xy(lua_State* L, const vec2i_t* vec);
 void script_wrap_cfuncs(lua_State* L, int index);
+int script_load_chunk(lua_State* L, const vfile_t* file);
 bool script_load_config(lua_State* L, vfile_t* file);
 void script_push_paths(lua_State* L, const char* ruleset, const char* gametype);
 void script_push_cpaths(lua_State* L, const char* ruleset, const char* gametype);
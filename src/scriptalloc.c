@@ -0,0 +1,513 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "scriptalloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "error.h"
+
+/**
+ * Every block is rounded up to a multiple of this many bytes.  This is also
+ * the alignment of every block.
+ */
+#define SCRIPTALLOC_GRANULE 8
+
+/**
+ * Number of pooled size classes.  Blocks that are larger than the largest
+ * size class come straight from malloc.
+ */
+#define SCRIPTALLOC_CLASSES 32
+
+/**
+ * Largest block that comes out of a pool.
+ */
+#define SCRIPTALLOC_MAX_POOLED (SCRIPTALLOC_CLASSES * SCRIPTALLOC_GRANULE)
+
+/**
+ * Size of a slab that pooled blocks are carved out of.
+ */
+#define SCRIPTALLOC_SLAB_SIZE (16 * 1024)
+
+/**
+ * Flag of a block that came from malloc even though it is small enough to
+ * be pooled.
+ */
+#define SCRIPTALLOC_UNPOOLED 0x1
+
+/**
+ * Header in front of every block, so it can be charged back to the account
+ * that allocated it when it is freed.
+ */
+typedef union {
+    struct {
+        uint16_t account;
+        uint16_t flags;
+        uint32_t generation;
+    } owner;
+
+    // Keep the block after the header aligned for anything Lua stores.
+    double d;
+    void* p;
+    long long i;
+} scriptalloc_header_t;
+
+/**
+ * A freed pooled block, waiting to be used again.
+ */
+typedef struct scriptalloc_free_s {
+    struct scriptalloc_free_s* next;
+} scriptalloc_free_t;
+
+/**
+ * Header of a slab.  Blocks are carved out of the space after it.
+ */
+typedef union scriptalloc_slab_u {
+    union scriptalloc_slab_u* next;
+    scriptalloc_header_t align;
+} scriptalloc_slab_t;
+
+/**
+ * A memory account and whether it is in use.
+ */
+typedef struct {
+    scriptalloc_account_t account;
+
+    /**
+     * Bumped every time the account is closed, so blocks that were charged
+     * to an earlier user of the account are never charged to a later one.
+     */
+    uint32_t generation;
+
+    /**
+     * True if the account is in use.
+     */
+    bool open;
+} scriptalloc_slot_t;
+
+typedef struct scriptalloc_s {
+    /**
+     * Freed blocks of every size class.
+     */
+    scriptalloc_free_t* free[SCRIPTALLOC_CLASSES];
+
+    /**
+     * Every slab that has been allocated.
+     */
+    scriptalloc_slab_t* slabs;
+
+    /**
+     * Unused space at the end of the newest slab.
+     */
+    uint8_t* bump;
+    size_t bump_size;
+
+    /**
+     * Every memory account.
+     */
+    scriptalloc_slot_t slots[MAX_SCRIPTALLOC_ACCOUNTS];
+
+    /**
+     * Account that new allocations are charged to.
+     */
+    uint32_t current;
+} scriptalloc_t;
+
+/**
+ * Allocate a pooled allocator for a Lua state
+ */
+scriptalloc_t* scriptalloc_new(void) {
+    scriptalloc_t* alloc = calloc(1, sizeof(scriptalloc_t));
+    if (alloc == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+
+    // The state account is always open.
+    alloc->slots[SCRIPTALLOC_STATE_ACCOUNT].open = true;
+    alloc->current = SCRIPTALLOC_STATE_ACCOUNT;
+
+    return alloc;
+
+fail:
+    scriptalloc_delete(alloc);
+    return NULL;
+}
+
+/**
+ * Free an allocator
+ *
+ * The Lua state that uses it must already be closed.
+ */
+void scriptalloc_delete(scriptalloc_t* alloc) {
+    if (alloc == NULL) {
+        return;
+    }
+
+    scriptalloc_slab_t* slab = alloc->slabs;
+    while (slab != NULL) {
+        scriptalloc_slab_t* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    free(alloc);
+}
+
+/**
+ * Allocate a raw block of a given size, including the header.
+ */
+static void* scriptalloc_raw_new(scriptalloc_t* alloc, size_t size) {
+    if (size > SCRIPTALLOC_MAX_POOLED) {
+        return malloc(size);
+    }
+
+    size_t index = (size - 1) / SCRIPTALLOC_GRANULE;
+    if (alloc->free[index] != NULL) {
+        scriptalloc_free_t* block = alloc->free[index];
+        alloc->free[index] = block->next;
+        return block;
+    }
+
+    // Carve a new block out of the newest slab.
+    size_t class_size = (index + 1) * SCRIPTALLOC_GRANULE;
+    if (alloc->bump_size < class_size) {
+        scriptalloc_slab_t* slab = malloc(SCRIPTALLOC_SLAB_SIZE);
+        if (slab == NULL) {
+            return NULL;
+        }
+        slab->next = alloc->slabs;
+        alloc->slabs = slab;
+
+        // Whatever was left of the old slab is too small to bother with.
+        alloc->bump = (uint8_t*)(slab + 1);
+        alloc->bump_size = SCRIPTALLOC_SLAB_SIZE - sizeof(*slab);
+    }
+
+    void* block = alloc->bump;
+    alloc->bump += class_size;
+    alloc->bump_size -= class_size;
+    return block;
+}
+
+/**
+ * Check if a raw block of a given size, including the header, came from
+ * malloc instead of a pool.
+ */
+static bool scriptalloc_raw_unpooled(const scriptalloc_header_t* header, size_t size) {
+    return size > SCRIPTALLOC_MAX_POOLED || (header->owner.flags & SCRIPTALLOC_UNPOOLED);
+}
+
+/**
+ * Free a raw block of a given size, including the header.
+ */
+static void scriptalloc_raw_delete(scriptalloc_t* alloc, scriptalloc_header_t* header, size_t size) {
+    if (scriptalloc_raw_unpooled(header, size)) {
+        free(header);
+        return;
+    }
+
+    size_t index = (size - 1) / SCRIPTALLOC_GRANULE;
+    scriptalloc_free_t* block = (scriptalloc_free_t*)header;
+    block->next = alloc->free[index];
+    alloc->free[index] = block;
+}
+
+/**
+ * Find the account that a block was charged to, or NULL if that account
+ * has been closed since.
+ */
+static scriptalloc_account_t* scriptalloc_owner(scriptalloc_t* alloc,
+                                                const scriptalloc_header_t* header) {
+    scriptalloc_slot_t* slot = &alloc->slots[header->owner.account];
+    if (slot->open == false || slot->generation != header->owner.generation) {
+        return NULL;
+    }
+
+    return &slot->account;
+}
+
+/**
+ * Change the number of bytes charged to an account.
+ *
+ * Returns false if growing would take the account over its limit.
+ * Shrinking always succeeds.
+ */
+static bool scriptalloc_charge(scriptalloc_account_t* account, size_t osize, size_t nsize) {
+    if (account == NULL) {
+        return true;
+    }
+
+    if (nsize > osize && account->limit != 0 &&
+        account->bytes + (nsize - osize) > account->limit) {
+        return false;
+    }
+
+    account->bytes = account->bytes - osize + nsize;
+    if (account->bytes > account->peak) {
+        account->peak = account->bytes;
+    }
+
+    return true;
+}
+
+/**
+ * Allocate a new block for Lua, charged to the current account.
+ */
+static void* scriptalloc_malloc(scriptalloc_t* alloc, size_t nsize) {
+    scriptalloc_account_t* account = &alloc->slots[alloc->current].account;
+    if (scriptalloc_charge(account, 0, nsize) == false) {
+        return NULL;
+    }
+
+    scriptalloc_header_t* header = scriptalloc_raw_new(alloc, sizeof(*header) + nsize);
+    if (header == NULL) {
+        scriptalloc_charge(account, nsize, 0);
+        return NULL;
+    }
+
+    header->owner.account = alloc->current;
+    header->owner.flags = 0;
+    header->owner.generation = alloc->slots[alloc->current].generation;
+    account->blocks += 1;
+    account->allocs += 1;
+
+    return header + 1;
+}
+
+/**
+ * Free a block of Lua's, crediting the account it was charged to.
+ */
+static void scriptalloc_free(scriptalloc_t* alloc, void* ptr, size_t osize) {
+    scriptalloc_header_t* header = (scriptalloc_header_t*)ptr - 1;
+
+    scriptalloc_account_t* account = scriptalloc_owner(alloc, header);
+    if (account != NULL) {
+        scriptalloc_charge(account, osize, 0);
+        account->blocks -= 1;
+    }
+
+    scriptalloc_raw_delete(alloc, header, sizeof(*header) + osize);
+}
+
+/**
+ * Resize a block of Lua's.  The block stays charged to the same account.
+ */
+static void* scriptalloc_realloc(scriptalloc_t* alloc, void* ptr, size_t osize, size_t nsize) {
+    scriptalloc_header_t* header = (scriptalloc_header_t*)ptr - 1;
+    size_t old_size = sizeof(*header) + osize;
+    size_t new_size = sizeof(*header) + nsize;
+
+    scriptalloc_account_t* account = scriptalloc_owner(alloc, header);
+    if (scriptalloc_charge(account, osize, nsize) == false) {
+        return NULL;
+    }
+
+    bool unpooled = scriptalloc_raw_unpooled(header, old_size);
+    if (unpooled && new_size > SCRIPTALLOC_MAX_POOLED) {
+        // Neither block is pooled, so the C library can resize in place.
+        scriptalloc_header_t* resized = realloc(header, new_size);
+        if (resized == NULL) {
+            if (nsize < osize) {
+                // Lua expects shrinking to always work, and the old block
+                // is big enough.
+                return ptr;
+            }
+            scriptalloc_charge(account, nsize, osize);
+            return NULL;
+        }
+        return resized + 1;
+    }
+
+    if (unpooled == false && new_size <= SCRIPTALLOC_MAX_POOLED &&
+        (old_size - 1) / SCRIPTALLOC_GRANULE == (new_size - 1) / SCRIPTALLOC_GRANULE) {
+        // Same size class, so the block already fits.
+        return ptr;
+    }
+
+    scriptalloc_header_t* moved = scriptalloc_raw_new(alloc, new_size);
+    if (moved == NULL) {
+        if (nsize < osize) {
+            // The old block is big enough, but if it came from malloc it
+            // has to go back there, whatever size Lua thinks it is now.
+            if (unpooled) {
+                header->owner.flags |= SCRIPTALLOC_UNPOOLED;
+            }
+            return ptr;
+        }
+        scriptalloc_charge(account, nsize, osize);
+        return NULL;
+    }
+
+    memcpy(moved, header, (old_size < new_size) ? old_size : new_size);
+    moved->owner.flags &= ~SCRIPTALLOC_UNPOOLED;
+    scriptalloc_raw_delete(alloc, header, old_size);
+    return moved + 1;
+}
+
+/**
+ * Allocation function of Lua states that use the allocator
+ *
+ * Small blocks come out of per-size pools, so the constant churn of short
+ * lived tables and strings doesn't go through malloc.
+ */
+void* scriptalloc_alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+    scriptalloc_t* alloc = ud;
+
+    if (nsize == 0) {
+        if (ptr != NULL) {
+            scriptalloc_free(alloc, ptr, osize);
+        }
+        return NULL;
+    } else if (ptr == NULL) {
+        // When ptr is NULL, osize is the type of object instead of a size.
+        return scriptalloc_malloc(alloc, nsize);
+    }
+
+    return scriptalloc_realloc(alloc, ptr, osize, nsize);
+}
+
+/**
+ * Get the allocator of a Lua state, or NULL if the state doesn't use one
+ */
+scriptalloc_t* scriptalloc_from_state(lua_State* L) {
+    void* ud = NULL;
+    if (lua_getallocf(L, &ud) != scriptalloc_alloc) {
+        return NULL;
+    }
+
+    return ud;
+}
+
+/**
+ * Open a new memory account with the given limit in bytes, or 0 for no
+ * limit
+ *
+ * Returns the account, or SCRIPTALLOC_STATE_ACCOUNT if every account is in
+ * use.
+ */
+uint32_t scriptalloc_open_account(scriptalloc_t* alloc, size_t limit) {
+    for (uint32_t i = 0;i < MAX_SCRIPTALLOC_ACCOUNTS;i++) {
+        scriptalloc_slot_t* slot = &alloc->slots[i];
+        if (slot->open == false) {
+            memset(&slot->account, 0x00, sizeof(slot->account));
+            slot->account.limit = limit;
+            slot->open = true;
+            return i;
+        }
+    }
+
+    error_push("Too many memory accounts.");
+    return SCRIPTALLOC_STATE_ACCOUNT;
+}
+
+/**
+ * Close a memory account
+ *
+ * Blocks that are still charged to the account aren't charged to anybody
+ * from then on.
+ */
+void scriptalloc_close_account(scriptalloc_t* alloc, uint32_t account) {
+    if (account == SCRIPTALLOC_STATE_ACCOUNT || account >= MAX_SCRIPTALLOC_ACCOUNTS) {
+        return;
+    }
+
+    alloc->slots[account].open = false;
+    alloc->slots[account].generation += 1;
+    if (alloc->current == account) {
+        alloc->current = SCRIPTALLOC_STATE_ACCOUNT;
+    }
+}
+
+/**
+ * Charge new allocations to a different account
+ *
+ * Returns the account that allocations were charged to before, so it can be
+ * switched back.
+ */
+uint32_t scriptalloc_switch_account(scriptalloc_t* alloc, uint32_t account) {
+    uint32_t previous = alloc->current;
+    if (account < MAX_SCRIPTALLOC_ACCOUNTS && alloc->slots[account].open) {
+        alloc->current = account;
+    }
+
+    return previous;
+}
+
+/**
+ * Get the memory usage of an account, or NULL if it isn't open
+ */
+const scriptalloc_account_t* scriptalloc_get_account(const scriptalloc_t* alloc, uint32_t account) {
+    if (account >= MAX_SCRIPTALLOC_ACCOUNTS || alloc->slots[account].open == false) {
+        return NULL;
+    }
+
+    return &alloc->slots[account].account;
+}
+
+/**
+ * Charge a block that was allocated outside of Lua to an account, so the
+ * account covers everything that is kept on its behalf
+ *
+ * Returns false if the block would take the account over its limit, in
+ * which case nothing is charged.
+ */
+bool scriptalloc_charge_block(scriptalloc_t* alloc, uint32_t account, size_t size) {
+    if (account >= MAX_SCRIPTALLOC_ACCOUNTS || alloc->slots[account].open == false) {
+        return true;
+    }
+
+    scriptalloc_account_t* info = &alloc->slots[account].account;
+    if (scriptalloc_charge(info, 0, size) == false) {
+        return false;
+    }
+
+    info->blocks += 1;
+    info->allocs += 1;
+    return true;
+}
+
+/**
+ * Credit an account for a block charged with scriptalloc_charge_block that
+ * has since been freed
+ */
+void scriptalloc_credit_block(scriptalloc_t* alloc, uint32_t account, size_t size) {
+    if (account >= MAX_SCRIPTALLOC_ACCOUNTS || alloc->slots[account].open == false) {
+        return;
+    }
+
+    scriptalloc_account_t* info = &alloc->slots[account].account;
+    scriptalloc_charge(info, size, 0);
+    info->blocks -= 1;
+}
+
+/**
+ * Set the limit of an account in bytes, or 0 for no limit
+ *
+ * Lowering the limit below what is already allocated doesn't free anything,
+ * it just makes any more allocations fail.
+ */
+void scriptalloc_set_limit(scriptalloc_t* alloc, uint32_t account, size_t limit) {
+    if (account >= MAX_SCRIPTALLOC_ACCOUNTS || alloc->slots[account].open == false) {
+        return;
+    }
+
+    alloc->slots[account].account.limit = limit;
+}
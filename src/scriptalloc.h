@@ -0,0 +1,77 @@
+/**
+ * This file is part of Portmino.
+ * 
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "define.h"
+
+// Forward declarations.
+typedef struct lua_State lua_State;
+typedef struct scriptalloc_s scriptalloc_t;
+
+/**
+ * Maximum number of memory accounts per allocator, including the account
+ * of the state itself.
+ */
+#define MAX_SCRIPTALLOC_ACCOUNTS 64
+
+/**
+ * Account of everything that isn't allocated on behalf of an environment.
+ */
+#define SCRIPTALLOC_STATE_ACCOUNT 0
+
+/**
+ * Memory that Lua has allocated on behalf of one account.
+ */
+typedef struct {
+    /**
+     * Bytes currently allocated.
+     */
+    size_t bytes;
+
+    /**
+     * Most bytes that were ever allocated at once.
+     */
+    size_t peak;
+
+    /**
+     * Number of blocks currently allocated.
+     */
+    size_t blocks;
+
+    /**
+     * Number of allocations made so far, including ones since freed.
+     */
+    size_t allocs;
+
+    /**
+     * Most bytes the account can have allocated at once, or 0 for no limit.
+     */
+    size_t limit;
+} scriptalloc_account_t;
+
+scriptalloc_t* scriptalloc_new(void);
+void scriptalloc_delete(scriptalloc_t* alloc);
+void* scriptalloc_alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+scriptalloc_t* scriptalloc_from_state(lua_State* L);
+uint32_t scriptalloc_open_account(scriptalloc_t* alloc, size_t limit);
+void scriptalloc_close_account(scriptalloc_t* alloc, uint32_t account);
+uint32_t scriptalloc_switch_account(scriptalloc_t* alloc, uint32_t account);
+const scriptalloc_account_t* scriptalloc_get_account(const scriptalloc_t* alloc, uint32_t account);
+bool scriptalloc_charge_block(scriptalloc_t* alloc, uint32_t account, size_t size);
+void scriptalloc_credit_block(scriptalloc_t* alloc, uint32_t account, size_t size);
+void scriptalloc_set_limit(scriptalloc_t* alloc, uint32_t account, size_t limit);
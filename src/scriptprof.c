@@ -0,0 +1,569 @@
+/**
+ * This file is part of Portmino.
+ *
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "scriptprof.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "error.h"
+
+/**
+ * Name of the registry field that points the hook at the profiler.
+ */
+#define SCRIPTPROF_REGISTRY "scriptprof"
+
+/**
+ * Longest collapsed stack that we record, including the terminator.
+ */
+#define SCRIPTPROF_STACK_SIZE 2048
+
+/**
+ * Initial number of buckets of the sample table.  Must be a power of two.
+ */
+#define SCRIPTPROF_INITIAL_BUCKETS 256
+
+/**
+ * Number of samples of one distinct stack.
+ */
+typedef struct {
+    /**
+     * Collapsed stack, from the root to the leaf, with frames separated by
+     * semicolons.  NULL if the bucket is empty.
+     */
+    char* stack;
+
+    /**
+     * Hash of the collapsed stack.
+     */
+    uint64_t hash;
+
+    /**
+     * Number of times the stack was sampled.
+     */
+    uint64_t count;
+} scriptprof_sample_t;
+
+/**
+ * A C binding that we count calls into.
+ */
+typedef struct {
+    /**
+     * Function that the binding calls.  Wrapping a binding with upvalues
+     * doesn't change this, so every environment shares the same count.
+     */
+    lua_CFunction func;
+
+    scriptprof_calls_t calls;
+} scriptprof_binding_t;
+
+typedef struct scriptprof_s {
+    /**
+     * Lua state that we are profiling.
+     *
+     * This pointer is not owned by this structure.  Do not free it.
+     */
+    lua_State* lua;
+
+    /**
+     * Number of Lua instructions between samples.
+     */
+    int period;
+
+    /**
+     * Sampled stacks, as an open-addressed hash table.
+     */
+    scriptprof_sample_t* samples;
+
+    /**
+     * Number of buckets in the sample table.  Always a power of two.
+     */
+    size_t buckets;
+
+    /**
+     * Number of distinct stacks in the sample table.
+     */
+    size_t distinct;
+
+    /**
+     * Number of samples taken.
+     */
+    uint64_t total;
+
+    /**
+     * Every C binding that we count calls into, sorted by function.
+     */
+    scriptprof_binding_t* bindings;
+
+    /**
+     * Number of C bindings.
+     */
+    size_t binding_count;
+
+    /**
+     * Number of frames that have ended.
+     */
+    uint32_t frames;
+} scriptprof_t;
+
+/**
+ * Hash a collapsed stack
+ */
+static uint64_t scriptprof_hash(const char* stack) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = stack; *c != '\0'; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Order bindings by the address of their function
+ */
+static int scriptprof_binding_cmp(const void* a, const void* b) {
+    uintptr_t fa = (uintptr_t)((const scriptprof_binding_t*)a)->func;
+    uintptr_t fb = (uintptr_t)((const scriptprof_binding_t*)b)->func;
+    return (fa > fb) - (fa < fb);
+}
+
+/**
+ * Find the binding of a C function, or NULL if it isn't one of ours
+ */
+static scriptprof_binding_t* scriptprof_find_binding(scriptprof_t* prof, lua_CFunction func) {
+    size_t lo = 0;
+    size_t hi = prof->binding_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((uintptr_t)prof->bindings[mid].func < (uintptr_t)func) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < prof->binding_count && prof->bindings[lo].func == func) {
+        return &prof->bindings[lo];
+    }
+    return NULL;
+}
+
+/**
+ * Double the number of buckets of the sample table
+ */
+static bool scriptprof_grow(scriptprof_t* prof) {
+    size_t buckets = prof->buckets * 2;
+    scriptprof_sample_t* samples = calloc(buckets, sizeof(scriptprof_sample_t));
+    if (samples == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0;i < prof->buckets;i++) {
+        if (prof->samples[i].stack == NULL) {
+            continue;
+        }
+
+        size_t j = prof->samples[i].hash & (buckets - 1);
+        while (samples[j].stack != NULL) {
+            j = (j + 1) & (buckets - 1);
+        }
+        samples[j] = prof->samples[i];
+    }
+
+    free(prof->samples);
+    prof->samples = samples;
+    prof->buckets = buckets;
+    return true;
+}
+
+/**
+ * Count one more sample of a collapsed stack
+ */
+static void scriptprof_record(scriptprof_t* prof, const char* stack) {
+    // Keep the table at most three quarters full.
+    if ((prof->distinct + 1) * 4 > prof->buckets * 3) {
+        if (scriptprof_grow(prof) == false) {
+            return;
+        }
+    }
+
+    uint64_t hash = scriptprof_hash(stack);
+    size_t i = hash & (prof->buckets - 1);
+    while (prof->samples[i].stack != NULL) {
+        if (prof->samples[i].hash == hash && strcmp(prof->samples[i].stack, stack) == 0) {
+            prof->samples[i].count += 1;
+            prof->total += 1;
+            return;
+        }
+        i = (i + 1) & (prof->buckets - 1);
+    }
+
+    char* copy = strdup(stack);
+    if (copy == NULL) {
+        return;
+    }
+
+    prof->samples[i].stack = copy;
+    prof->samples[i].hash = hash;
+    prof->samples[i].count = 1;
+    prof->distinct += 1;
+    prof->total += 1;
+}
+
+/**
+ * Write a description of a stack frame to a buffer
+ *
+ * Semicolons separate frames in the collapsed format, so none are written.
+ */
+static void scriptprof_describe(lua_Debug* ar, char* buffer, size_t size) {
+    if (strcmp(ar->what, "C") == 0) {
+        snprintf(buffer, size, "%s [C]", ar->name != NULL ? ar->name : "?");
+    } else if (strcmp(ar->what, "main") == 0) {
+        snprintf(buffer, size, "main chunk (%s:%d)", ar->short_src, ar->currentline);
+    } else {
+        snprintf(buffer, size, "%s (%s:%d)", ar->name != NULL ? ar->name : "?",
+                 ar->short_src, ar->currentline);
+    }
+
+    for (char* c = buffer; *c != '\0'; c++) {
+        if (*c == ';') {
+            *c = ',';
+        }
+    }
+}
+
+/**
+ * Sample the stack of the running Lua function
+ */
+static void scriptprof_sample(scriptprof_t* prof, lua_State* L) {
+    char frames[MAX_SCRIPTPROF_DEPTH][128];
+    int depth = 0;
+
+    lua_Debug ar;
+    while (depth < MAX_SCRIPTPROF_DEPTH && lua_getstack(L, depth, &ar) != 0) {
+        lua_getinfo(L, "nSl", &ar);
+        scriptprof_describe(&ar, frames[depth], sizeof(frames[depth]));
+        depth += 1;
+    }
+    if (depth == 0) {
+        return;
+    }
+
+    // Collapsed stacks go from the root to the leaf, the opposite of the
+    // order we walked the stack in.
+    char stack[SCRIPTPROF_STACK_SIZE];
+    size_t len = 0;
+    stack[0] = '\0';
+    if (depth == MAX_SCRIPTPROF_DEPTH && lua_getstack(L, depth, &ar) != 0) {
+        len += snprintf(stack, sizeof(stack), "(truncated)");
+    }
+    for (int i = depth - 1;i >= 0 && len < sizeof(stack);i--) {
+        len += snprintf(stack + len, sizeof(stack) - len, "%s%s",
+                        len > 0 ? ";" : "", frames[i]);
+    }
+
+    scriptprof_record(prof, stack);
+}
+
+/**
+ * Count a call if it went into one of our C bindings
+ */
+static void scriptprof_call(scriptprof_t* prof, lua_State* L, lua_Debug* ar) {
+    lua_getinfo(L, "f", ar);
+    lua_CFunction func = lua_tocfunction(L, -1);
+    lua_pop(L, 1);
+    if (func == NULL) {
+        return;
+    }
+
+    scriptprof_binding_t* binding = scriptprof_find_binding(prof, func);
+    if (binding != NULL) {
+        binding->calls.frame += 1;
+        binding->calls.total += 1;
+    }
+}
+
+/**
+ * Debug hook that does all of the profiling
+ */
+static void scriptprof_hook(lua_State* L, lua_Debug* ar) {
+    lua_getfield(L, LUA_REGISTRYINDEX, SCRIPTPROF_REGISTRY);
+    scriptprof_t* prof = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (prof == NULL) {
+        return;
+    }
+
+    switch (ar->event) {
+    case LUA_HOOKCOUNT:
+        scriptprof_sample(prof, L);
+        break;
+    case LUA_HOOKCALL:
+    case LUA_HOOKTAILCALL:
+        scriptprof_call(prof, L, ar);
+        break;
+    }
+}
+
+/**
+ * Find every C function of every mino_* module so we can count calls into
+ * them
+ */
+static bool scriptprof_find_bindings(scriptprof_t* prof) {
+    lua_State* L = prof->lua;
+    size_t capacity = 0;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0) {
+        // Skip anything that isn't one of our modules.
+        if (lua_type(L, -2) != LUA_TSTRING || lua_type(L, -1) != LUA_TTABLE ||
+            strncmp(lua_tostring(L, -2), "mino_", 5) != 0) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        const char* module = lua_tostring(L, -2);
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            lua_CFunction func = lua_tocfunction(L, -1);
+            if (lua_type(L, -2) != LUA_TSTRING || func == NULL) {
+                lua_pop(L, 1);
+                continue;
+            }
+
+            if (prof->binding_count == capacity) {
+                size_t size = capacity == 0 ? 64 : capacity * 2;
+                scriptprof_binding_t* bindings = realloc(prof->bindings,
+                    size * sizeof(scriptprof_binding_t));
+                if (bindings == NULL) {
+                    error_push_allocerr();
+                    lua_pop(L, 4);
+                    return false;
+                }
+                prof->bindings = bindings;
+                capacity = size;
+            }
+
+            const char* field = lua_tostring(L, -2);
+            size_t size = strlen(module) + strlen(field) + 2;
+            char* name = malloc(size);
+            if (name == NULL) {
+                error_push_allocerr();
+                lua_pop(L, 4);
+                return false;
+            }
+            snprintf(name, size, "%s.%s", module, field);
+
+            scriptprof_binding_t* binding = &prof->bindings[prof->binding_count];
+            memset(binding, 0, sizeof(*binding));
+            binding->func = func;
+            binding->calls.name = name;
+            prof->binding_count += 1;
+
+            lua_pop(L, 1);
+        }
+
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    qsort(prof->bindings, prof->binding_count, sizeof(scriptprof_binding_t),
+          scriptprof_binding_cmp);
+    return true;
+}
+
+/**
+ * Allocate a profiler for a Lua state
+ *
+ * Every module of ours must already be loaded into the state, so we know
+ * which C functions to count calls into.  Pass the number of Lua
+ * instructions to run between samples, or 0 for the default.
+ */
+scriptprof_t* scriptprof_new(lua_State* L, int period) {
+    scriptprof_t* prof = calloc(1, sizeof(scriptprof_t));
+    if (prof == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+
+    prof->lua = L;
+    prof->period = period > 0 ? period : SCRIPTPROF_DEFAULT_PERIOD;
+
+    prof->buckets = SCRIPTPROF_INITIAL_BUCKETS;
+    if ((prof->samples = calloc(prof->buckets, sizeof(scriptprof_sample_t))) == NULL) {
+        error_push_allocerr();
+        goto fail;
+    }
+
+    if (scriptprof_find_bindings(prof) == false) {
+        goto fail;
+    }
+
+    // The hook only gets the Lua state, so it finds us through the registry.
+    lua_pushlightuserdata(L, prof);
+    lua_setfield(L, LUA_REGISTRYINDEX, SCRIPTPROF_REGISTRY);
+
+    return prof;
+
+fail:
+    scriptprof_delete(prof);
+    return NULL;
+}
+
+/**
+ * Free a profiler
+ */
+void scriptprof_delete(scriptprof_t* prof) {
+    if (prof == NULL) {
+        return;
+    }
+
+    if (prof->lua != NULL) {
+        lua_getfield(prof->lua, LUA_REGISTRYINDEX, SCRIPTPROF_REGISTRY);
+        if (lua_touserdata(prof->lua, -1) == prof) {
+            scriptprof_stop(prof);
+            lua_pushnil(prof->lua);
+            lua_setfield(prof->lua, LUA_REGISTRYINDEX, SCRIPTPROF_REGISTRY);
+        }
+        lua_pop(prof->lua, 1);
+    }
+
+    if (prof->samples != NULL) {
+        for (size_t i = 0;i < prof->buckets;i++) {
+            free(prof->samples[i].stack);
+        }
+        free(prof->samples);
+        prof->samples = NULL;
+    }
+
+    if (prof->bindings != NULL) {
+        for (size_t i = 0;i < prof->binding_count;i++) {
+            free((char*)prof->bindings[i].calls.name);
+        }
+        free(prof->bindings);
+        prof->bindings = NULL;
+    }
+
+    free(prof);
+}
+
+/**
+ * Start sampling and counting calls
+ */
+void scriptprof_start(scriptprof_t* prof) {
+    lua_sethook(prof->lua, scriptprof_hook, LUA_MASKCOUNT | LUA_MASKCALL, prof->period);
+}
+
+/**
+ * Stop sampling and counting calls
+ */
+void scriptprof_stop(scriptprof_t* prof) {
+    lua_sethook(prof->lua, NULL, 0, 0);
+}
+
+/**
+ * Finish counting the calls of the current frame
+ */
+void scriptprof_end_frame(scriptprof_t* prof) {
+    for (size_t i = 0;i < prof->binding_count;i++) {
+        scriptprof_calls_t* calls = &prof->bindings[i].calls;
+        calls->last = calls->frame;
+        if (calls->frame > calls->most) {
+            calls->most = calls->frame;
+        }
+        calls->frame = 0;
+    }
+
+    prof->frames += 1;
+}
+
+/**
+ * Get the number of samples taken
+ */
+uint64_t scriptprof_get_samples(const scriptprof_t* prof) {
+    return prof->total;
+}
+
+/**
+ * Get the number of frames that have ended
+ */
+uint32_t scriptprof_get_frames(const scriptprof_t* prof) {
+    return prof->frames;
+}
+
+/**
+ * Get the calls into a C binding by name, such as "mino_board.get_cell"
+ *
+ * Returns NULL if there is no such binding.
+ */
+const scriptprof_calls_t* scriptprof_get_calls(const scriptprof_t* prof, const char* name) {
+    for (size_t i = 0;i < prof->binding_count;i++) {
+        if (strcmp(prof->bindings[i].calls.name, name) == 0) {
+            return &prof->bindings[i].calls;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Write every sampled stack in the collapsed format that flamegraph tools
+ * read, one stack and its sample count per line
+ */
+bool scriptprof_write_stacks(const scriptprof_t* prof, FILE* file) {
+    for (size_t i = 0;i < prof->buckets;i++) {
+        const scriptprof_sample_t* sample = &prof->samples[i];
+        if (sample->stack == NULL) {
+            continue;
+        }
+
+        if (fprintf(file, "%s %llu\n", sample->stack, (unsigned long long)sample->count) < 0) {
+            error_push("Could not write profile.");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Write the number of calls into every C binding that was called at all
+ */
+bool scriptprof_write_calls(const scriptprof_t* prof, FILE* file) {
+    uint32_t frames = prof->frames > 0 ? prof->frames : 1;
+
+    for (size_t i = 0;i < prof->binding_count;i++) {
+        const scriptprof_calls_t* calls = &prof->bindings[i].calls;
+        if (calls->total == 0) {
+            continue;
+        }
+
+        if (fprintf(file, "%s: %llu calls, %.2f per frame, %u at most\n", calls->name,
+                    (unsigned long long)calls->total, (double)calls->total / frames,
+                    calls->most) < 0) {
+            error_push("Could not write profile.");
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,78 @@
+/**
+ * This file is part of Portmino.
+ *
+ * Portmino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Portmino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Portmino.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "define.h"
+
+#include <stdio.h>
+
+// Forward declarations.
+typedef struct lua_State lua_State;
+typedef struct scriptprof_s scriptprof_t;
+
+/**
+ * Default number of Lua instructions between samples.
+ */
+#define SCRIPTPROF_DEFAULT_PERIOD 1000
+
+/**
+ * Maximum number of stack frames recorded per sample.  Deeper frames
+ * towards the root of the stack are cut off.
+ */
+#define MAX_SCRIPTPROF_DEPTH 32
+
+/**
+ * Number of calls made into a single C binding.
+ */
+typedef struct {
+    /**
+     * Name of the binding, such as "mino_board.get_cell".
+     */
+    const char* name;
+
+    /**
+     * Number of calls made over every frame.
+     */
+    uint64_t total;
+
+    /**
+     * Number of calls made in the current frame so far.
+     */
+    uint32_t frame;
+
+    /**
+     * Number of calls made in the last complete frame.
+     */
+    uint32_t last;
+
+    /**
+     * Most calls made in any one frame.
+     */
+    uint32_t most;
+} scriptprof_calls_t;
+
+scriptprof_t* scriptprof_new(lua_State* L, int period);
+void scriptprof_delete(scriptprof_t* prof);
+void scriptprof_start(scriptprof_t* prof);
+void scriptprof_stop(scriptprof_t* prof);
+void scriptprof_end_frame(scriptprof_t* prof);
+uint64_t scriptprof_get_samples(const scriptprof_t* prof);
+uint32_t scriptprof_get_frames(const scriptprof_t* prof);
+const scriptprof_calls_t* scriptprof_get_calls(const scriptprof_t* prof, const char* name);
+bool scriptprof_write_stacks(const scriptprof_t* prof, FILE* file);
+bool scriptprof_write_calls(const scriptprof_t* prof, FILE* file);
@@ -31,6 +31,7 @@
 #include "frontend.h"
 #include "game.h"
 #include "platform.h"
+#include "script.h"
 #include "softrender.h"
 
 static SDL_Window* g_window;
@@ -193,9 +194,15 @@ static void sdl_run(void) {
     SDL_RenderPresent(g_renderer);
     double render_time = (SDL_GetPerformanceCounter() - pcount) / g_pfreq;
 
+#ifdef __EMSCRIPTEN__
+    // The browser runs our frames, so we never see the leftover time.
+    game_collect(1000.0 / MINO_FPS);
+#endif
+
     if (false) {
-        SDL_Log("game %f, draw %f, render %f\n", game_time, draw_time,
-                render_time);
+        const script_gc_t* gc = game_get_gc();
+        SDL_Log("game %f, draw %f, render %f, gc %f (longest %f)\n", game_time,
+                draw_time, render_time, gc->last_ms, gc->longest_ms);
     }
 
     return;
@@ -232,6 +239,13 @@ void sdl_loop(void) {
         sdl_run();
         int32_t ftime = SDL_GetTicks() - fstart;
 
+        if (ftime < ftarget) {
+            // Collect garbage in the time we would otherwise sleep through,
+            // keeping a millisecond spare so we don't go over.
+            game_collect(ftarget - ftime - 1);
+            ftime = SDL_GetTicks() - fstart;
+        }
+
         if (ftime < ftarget) {
             // Sleep the rest of the frametime.
             SDL_Delay(ftarget - ftime);
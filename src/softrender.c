@@ -41,6 +41,43 @@ static picture_t* g_board;
 static softblock_t* g_block;
 static softfont_t* g_font;
 
+// FIXME: Stop hardcoding the alpha value
+#define BOARD_ALPHA 192
+
+// Maximum number of boards that we keep a cached picture of.
+#define MAX_BOARD_CACHE 4
+
+/**
+ * Cached picture of the blocks on a board.
+ */
+typedef struct {
+    /**
+     * Id of the board that is cached, or 0 if this entry is unused.
+     */
+    size_t board_id;
+
+    /**
+     * Generation of the board that the picture is up to date with.
+     */
+    uint32_t generation;
+
+    /**
+     * Board background with every visible block drawn on top, ready to be
+     * blitted in one go.
+     */
+    picture_t* picture;
+
+    /**
+     * Frame that the entry was last drawn on, for picking an entry to evict.
+     */
+    uint32_t frame;
+} softrender_boardcache_t;
+
+// Board background with the board alpha already applied.
+static picture_t* g_board_faded;
+static softrender_boardcache_t g_board_cache[MAX_BOARD_CACHE];
+static uint32_t g_board_frame;
+
 static bool softrender_init(void) {
     size_t size = MINO_SOFTRENDER_WIDTH * MINO_SOFTRENDER_HEIGHT * MINO_SOFTRENDER_BPP;
 
@@ -60,6 +97,20 @@ static bool softrender_init(void) {
         goto fail;
     }
 
+    if ((g_board_faded = picture_new(g_board->width, g_board->height)) == NULL) {
+        goto fail;
+    }
+    picture_copy(g_board_faded, vec2i_zero(), g_board, vec2i_zero());
+    picture_scale_alpha(g_board_faded, BOARD_ALPHA);
+
+    for (size_t i = 0;i < MAX_BOARD_CACHE;i++) {
+        g_board_cache[i].picture = picture_new(g_board->width, g_board->height);
+        if (g_board_cache[i].picture == NULL) {
+            goto fail;
+        }
+        g_board_cache[i].board_id = 0;
+    }
+
     if ((g_block = softblock_new("block/default/8px.png")) == NULL) {
         goto fail;
     }
@@ -83,6 +134,15 @@ static void softrender_deinit(void) {
     picture_delete(g_board);
     g_board = NULL;
 
+    picture_delete(g_board_faded);
+    g_board_faded = NULL;
+
+    for (size_t i = 0;i < MAX_BOARD_CACHE;i++) {
+        picture_delete(g_board_cache[i].picture);
+        g_board_cache[i].picture = NULL;
+        g_board_cache[i].board_id = 0;
+    }
+
     softblock_delete(g_block);
     g_block = NULL;
 
@@ -118,41 +178,97 @@ static void softrender_draw_background(void) {
     picture_copy(&g_render_ctx.buffer, vec2i_zero(), g_back, vec2i_zero());
 }
 
+/**
+ * Find the cached picture of a board, or evict the oldest one to make room.
+ *
+ * Returns true if the cached picture belongs to the board already.
+ */
+static bool softrender_find_cache(const board_t* board, softrender_boardcache_t** cache) {
+    softrender_boardcache_t* oldest = &g_board_cache[0];
+    for (size_t i = 0;i < MAX_BOARD_CACHE;i++) {
+        if (g_board_cache[i].board_id == board->id) {
+            *cache = &g_board_cache[i];
+            return true;
+        }
+        if (g_board_cache[i].frame < oldest->frame) {
+            oldest = &g_board_cache[i];
+        }
+    }
+
+    oldest->board_id = board->id;
+    *cache = oldest;
+    return false;
+}
+
+/**
+ * Redraw one visible row of the board into its cached picture.
+ */
+static void softrender_cache_row(softrender_boardcache_t* cache, const board_t* board,
+                                 int y, int start, vec2i_t blocksize) {
+    int iy = y - start;
+    const uint8_t* row = board->data.data + y * board->config.width;
+
+    // Clear the row back to the board background.
+    vec2i_t rowpos = vec2i(0, blocksize.y * iy);
+    picture_copy_area(cache->picture, rowpos, g_board_faded, rowpos,
+                      vec2i(g_board->width, blocksize.y));
+
+    // Draw the blocks on the row, skipping empty cells using the row mask.
+    // Blocks are opaque, so they can be copied instead of blended.
+    for (rowmask_t mask = board->data.rows[y];mask != 0;mask &= mask - 1) {
+        // What type of block are we rendering?
+        int ix = rowmask_ctz(mask);
+        uint8_t btype = row[ix];
+        picture_t* bpic = softblock_get(g_block, --btype);
+        if (bpic == NULL) {
+            // Not a block type we have a picture for.
+            continue;
+        }
+
+        // Draw a block.
+        picture_copy(cache->picture, vec2i(blocksize.x * ix, blocksize.y * iy),
+                     bpic, vec2i_zero());
+    }
+}
+
 /**
  * Draw a board and any attached pieces on the screen using the software renderer
  */
 static void softrender_draw_board(vec2i_t pos, const board_t* board) {
-    // FIXME: Stop hardcoding the alpha value
-    picture_blit_alpha(&g_render_ctx.buffer, vec2i(pos.x, pos.y), g_board, vec2i_zero(), 192);
-
     // The presumed size of a single empty cell in the board.  I feel
     // precalculating these sizes has a better failure mode than relying
     // on each and every block size to be correct.
     int blockx = g_board->width / board->config.width;
     int blocky = g_board->height / board->config.visible_height;
 
-    // What index of the board do we start at?
-    int start = (board->config.height - board->config.visible_height) * board->config.width;
-
-    // Draw the blocks on the board.
-    for (size_t i = start;i < board->data.size;i++) {
-        // What type of block are we rendering?
-        uint8_t btype = board->data.data[i];
-        if (!btype) {
-            continue;
+    // What row of the board do we start at?
+    int start = board->config.height - board->config.visible_height;
+
+    // Bring the cached picture of the board up to date, only redrawing the
+    // rows that changed since we last saw the board.
+    softrender_boardcache_t* cache = NULL;
+    uint64_t changed = 0;
+    if (softrender_find_cache(board, &cache) == false) {
+        picture_copy(cache->picture, vec2i_zero(), g_board_faded, vec2i_zero());
+        changed = ~(uint64_t)0;
+    } else if (cache->generation != board->generation) {
+        changed = board_get_changed(board, cache->generation);
+    }
+    cache->generation = board->generation;
+    cache->frame = ++g_board_frame;
+
+    changed >>= start;
+    while (changed != 0) {
+        int y = start + rowmask_ctz(changed);
+        changed &= changed - 1;
+        if (y >= board->config.height) {
+            break;
         }
-        picture_t* bpic = softblock_get(g_block, --btype);
-
-        // What is the actual (x, y) coordinate of the block?
-        int ix = i % board->config.width;
-        int iy = (i / board->config.width) - (board->config.height - board->config.visible_height);
-
-        // Draw a block.
-        picture_blit(&g_render_ctx.buffer,
-            vec2i(pos.x + (blockx * ix), pos.y + (blocky * iy)),
-            bpic, vec2i_zero());
+        softrender_cache_row(cache, board, y, start, vec2i(blockx, blocky));
     }
 
+    picture_blit(&g_render_ctx.buffer, vec2i(pos.x, pos.y), cache->picture, vec2i_zero());
+
     // Draw pieces, if any.  The normal piece is drawn after the ghost piece
     // so it gets drawn over top of the ghost in case of overlap.
     for (size_t i = 0;i < MAX_BOARD_PIECES;i++) {
@@ -164,20 +280,16 @@ static void softrender_draw_board(vec2i_t pos, const board_t* board) {
             }
             piece_t* piece = entity->data;
 
-            size_t i = bpiece->rot * piece->config->data_size;
-            size_t end = i + piece->config->data_size;
-            for (int j = 0;i < end;i++, j++) {
+            const piece_shape_t* shape = piece_config_get_shape(piece->config, bpiece->rot);
+            for (size_t j = 0;j < shape->cell_count;j++) {
                 // What type of block are we rendering?
-                uint8_t btype = piece->config->data[i];
-                if (!btype) {
-                    continue;
-                }
+                const piece_cell_t* cell = &shape->cells[j];
+                uint8_t btype = cell->value;
                 picture_t* bpic = softblock_get(g_block, --btype);
 
                 // What is the actual (x, y) coordinate of the block?
-                int ix = bpiece->pos.x + (j % piece->config->width);
-                int iy = bpiece->pos.y + (j / piece->config->width);
-                iy -= board->config.height - board->config.visible_height;
+                int ix = bpiece->pos.x + cell->x;
+                int iy = bpiece->pos.y + cell->y - start;
 
                 if (iy < 0) {
                     // Don't draw a block above the visible height.
@@ -270,23 +382,16 @@ static void softrender_draw_piece(vec2i_t pos, const piece_config_t* piece) {
     int blockx = 8;
     int blocky = 8;
 
-    size_t i = piece->spawn_rot * piece->data_size;
-    size_t end = i + piece->data_size;
-    for (int j = 0;i < end;i++, j++) {
+    const piece_shape_t* shape = piece_config_get_shape(piece, piece->spawn_rot);
+    for (size_t i = 0;i < shape->cell_count;i++) {
         // What type of block are we rendering?
-        uint8_t btype = piece->data[i];
-        if (!btype) {
-            continue;
-        }
+        const piece_cell_t* cell = &shape->cells[i];
+        uint8_t btype = cell->value;
         picture_t* bpic = softblock_get(g_block, --btype);
 
-        // What is the actual (x, y) coordinate of the block?
-        int ix = j % piece->width;
-        int iy = j / piece->width;
-
         // Draw a single block of the piece.
         picture_blit(&g_render_ctx.buffer,
-            vec2i(pos.x + (ix * blockx), pos.y + (iy * blocky)),
+            vec2i(pos.x + (cell->x * blockx), pos.y + (cell->y * blocky)),
             bpic, vec2i_zero());
     }
 }
@@ -32,6 +32,16 @@
  */
 #define MINO_DEFAULT_RESOURCE "basemino"
 
+/**
+ * Name that the in-binary resource pack is mounted as
+ */
+#define MINO_EMBEDDED_RESOURCE MINO_DEFAULT_RESOURCE ".pk3"
+
+/**
+ * Directory of the resource pack that precompiled chunks are stored in
+ */
+#define MINO_COMPILED_DIR "luac"
+
 /**
  * Designate loading paths for a resource pack with a given name
  */
@@ -77,7 +87,7 @@ bool vfs_init(const char* argv0) {
     buffer_t* basemino = NULL;
     if ((basemino = frontend_basemino()) != NULL) {
         int ok = PHYSFS_mountMemory(basemino->data, basemino->size, NULL,
-                                    MINO_DEFAULT_RESOURCE ".pk3", NULL, 0);
+                                    MINO_EMBEDDED_RESOURCE, NULL, 0);
         if (!ok) {
             error_push("Error attempting to mount in-memory archive.");
             return false;
@@ -143,6 +153,45 @@ fail:
     return NULL;
 }
 
+/**
+ * Check to see if a virtual filename is served by the in-binary resource pack
+ */
+static bool vfs_is_embedded(const char* filename) {
+    const char* dir = PHYSFS_getRealDir(filename);
+    return dir != NULL && strcmp(dir, MINO_EMBEDDED_RESOURCE) == 0;
+}
+
+/**
+ * Obtain the precompiled chunk of a script by the virtual filename of its
+ * source
+ *
+ * Precompiled chunks are only trusted if both they and their source are
+ * served by the in-binary resource pack.  That way a resource pack on disk
+ * can never supply bytecode, and a chunk can never be used in place of a
+ * source that a resource pack on disk has overridden.  Returns NULL if
+ * there is no trusted chunk.
+ *
+ * The returned file struct must be freed by the caller.
+ */
+vfile_t* vfs_vfile_new_compiled(const char* filename) {
+    if (vfs_is_embedded(filename) == false) {
+        return NULL;
+    }
+
+    char* compiled = vfs_path_join(MINO_COMPILED_DIR, filename, '/');
+    if (compiled == NULL) {
+        return NULL;
+    }
+
+    vfile_t* file = NULL;
+    if (vfs_is_embedded(compiled)) {
+        file = vfs_vfile_new(compiled, MINO_VFILE_NOERR);
+    }
+
+    free(compiled);
+    return file;
+}
+
 /**
  * Delete a file struct
  */
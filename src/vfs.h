@@ -51,5 +51,6 @@ typedef struct vfile_s {
 bool vfs_init(const char* argv0);
 void vfs_deinit(void);
 vfile_t* vfs_vfile_new(const char* filename, vfile_flags_t flags);
+vfile_t* vfs_vfile_new_compiled(const char* filename);
 void vfs_vfile_delete(vfile_t* file);
 char* vfs_path_join(const char* base, const char* append, char sep);
@@ -5,6 +5,7 @@
 #include <stdio.h>
 
 #include "basemino.h"
+#include "entity.h"
 #include "error.h"
 #include "frontend.h"
 
@@ -22,6 +23,15 @@ static void test_fatalerror(const char *fmt, va_list va) {
     fail_msg("fatalerror triggered\n");
 }
 
+/**
+ * Group teardown of tests that create entities, so the entity pools don't
+ * show up as leaks.
+ */
+static int test_entity_teardown(void** state) {
+    entity_pools_free();
+    return 0;
+}
+
 static frontend_module_t g_frontend_module = {
     test_basemino,
     test_fatalerror,
@@ -0,0 +1,758 @@
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "test.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "board.h"
+#include "entity.h"
+#include "environment.h"
+#include "kicks.h"
+#include "piece.h"
+#include "platform.h"
+#include "script.h"
+#include "serialize.h"
+#include "vfs.h"
+
+static piece_config_t* test_t_piece(lua_State* L) {
+    int ok = luaL_dostring(L, "return {"
+        "data = { 0, 9, 0, 9, 9, 9, 0, 0, 0,"
+                 "0, 9, 0, 0, 9, 9, 0, 9, 0,"
+                 "0, 0, 0, 9, 9, 9, 0, 9, 0,"
+                 "0, 9, 0, 9, 9, 0, 0, 9, 0 },"
+        "spawn_pos = { x = 3, y = 1 }, spawn_rot = 0, width = 3, height = 3 }");
+    assert_true(ok == LUA_OK);
+
+    piece_config_t* piece = piece_config_new(L, "t_piece");
+    assert_non_null(piece);
+    return piece;
+}
+
+static lua_Integer test_env_integer(environment_t* env, const char* name) {
+    lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->env_ref);
+    lua_getfield(env->lua, -1, name);
+    assert_true(lua_isinteger(env->lua, -1));
+    lua_Integer value = lua_tointeger(env->lua, -1);
+    lua_pop(env->lua, 2);
+    return value;
+}
+
+static bool test_env_boolean(environment_t* env, const char* name) {
+    lua_rawgeti(env->lua, LUA_REGISTRYINDEX, env->env_ref);
+    lua_getfield(env->lua, -1, name);
+    assert_true(lua_isboolean(env->lua, -1));
+    bool value = lua_toboolean(env->lua, -1);
+    lua_pop(env->lua, 2);
+    return value;
+}
+
+static void test_fill_row(board_t* board, int y, const char* row) {
+    for (int x = 0;x < board->config.width;x++) {
+        if (row[x] == 'X') {
+            board->data.data[y * board->config.width + x] = 1;
+            board->data.rows[y] |= (rowmask_t)1 << x;
+            if (board->config.height - y > board->data.heights[x]) {
+                board->data.heights[x] = board->config.height - y;
+            }
+        }
+    }
+}
+
+static void test_board_collision(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    board_config_t config = { 10, 22, 20 };
+    board_t* board = board_new(&config);
+    assert_non_null(board);
+
+    // Empty board, piece fits at spawn.
+    assert_true(board_test_piece(board, piece, vec2i(3, 1), 0));
+
+    // Empty top row of the piece can hang off the top of the board.
+    assert_true(board_test_piece(board, piece, vec2i(3, -1), 2));
+    assert_false(board_test_piece(board, piece, vec2i(3, -2), 2));
+
+    // Empty left column of the piece can hang off the left of the board.
+    assert_true(board_test_piece(board, piece, vec2i(-1, 0), 1));
+    assert_false(board_test_piece(board, piece, vec2i(-1, 0), 0));
+    assert_false(board_test_piece(board, piece, vec2i(8, 0), 0));
+    assert_false(board_test_piece(board, piece, vec2i(3, 21), 0));
+
+    // Locked pieces collide and show up in both the cells and the masks.
+    board_lock_piece(board, piece, vec2i(0, 20), 0);
+    assert_true(board_get(board, vec2i(0, 21)) == 9);
+    assert_true(board->data.rows[20] == 0x2);
+    assert_true(board->data.rows[21] == 0x7);
+    assert_false(board_test_piece(board, piece, vec2i(1, 20), 0));
+    assert_true(board_test_piece(board, piece, vec2i(3, 20), 0));
+
+    // Batched tests return the first offset that fits.
+    const vec2i_t offsets[] = { { 0, 0 }, { 2, 0 }, { 3, 0 } };
+    assert_true(board_test_positions(board, piece, vec2i(1, 20), 0, offsets, 3) == 1);
+    assert_true(board_test_positions(board, piece, vec2i(1, 20), 0, offsets, 1) == -1);
+
+    // Column heights and wells follow the stack.
+    assert_true(board_get_height(board, 1) == 2);
+    assert_true(board_get_height(board, 3) == 0);
+    assert_true(board_get_well(board, 0) == 1);
+    assert_true(board_get_well(board, 1) == 0);
+    assert_true(board_drop_distance(board, piece, vec2i(3, 0), 0) == 20);
+    assert_true(board_drop_distance(board, piece, vec2i(1, 0), 0) == 18);
+
+    vec2i_t dst = board_test_piece_between(board, piece, vec2i(1, 0), 0, vec2i(1, 22));
+    assert_true(dst.x == 1 && dst.y == 18);
+
+    // Fill out the bottom row and clear it.
+    board_lock_piece(board, piece, vec2i(3, 20), 0);
+    board_lock_piece(board, piece, vec2i(6, 20), 0);
+    board_lock_piece(board, piece, vec2i(8, 19), 3);
+    uint64_t cleared = 0;
+    assert_true(board_clear_lines(board, &cleared) == 1);
+    assert_true(cleared == (uint64_t)1 << 21);
+    assert_true(board->data.rows[21] == 0x392);
+    assert_true(board_get(board, vec2i(1, 21)) == 9);
+    assert_true(board_get(board, vec2i(0, 21)) == 0);
+    assert_true(board_get_height(board, 0) == 0);
+    assert_true(board_get_height(board, 1) == 1);
+
+    board_delete(board);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_board_config(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    // Rows can't be wider than a single row mask.
+    int ok = luaL_dostring(L, "return { width = 65, height = 40 }");
+    assert_true(ok == LUA_OK);
+    assert_null(board_config_new(L));
+    lua_pop(L, 1);
+
+    // Visible height defaults to the whole board.
+    ok = luaL_dostring(L, "return { width = 64, height = 40 }");
+    assert_true(ok == LUA_OK);
+    board_config_t* config = board_config_new(L);
+    assert_non_null(config);
+    assert_true(config->visible_height == 40);
+
+    // A board as wide as a row mask works just like a normal one.
+    piece_config_t* piece = test_t_piece(L);
+    board_t* board = board_new(config);
+    assert_non_null(board);
+    assert_true(board->data.full_row == ~(rowmask_t)0);
+    assert_true(board_test_piece(board, piece, vec2i(61, 0), 0));
+    assert_false(board_test_piece(board, piece, vec2i(62, 0), 0));
+    assert_true(board_drop_distance(board, piece, vec2i(61, 0), 0) == 38);
+
+    board_lock_piece(board, piece, vec2i(61, 38), 0);
+    assert_true(board->data.rows[39] == (rowmask_t)0x7 << 61);
+    assert_true(board_get_height(board, 62) == 2);
+
+    board_delete(board);
+    piece_config_delete(piece);
+    board_config_delete(config);
+    script_closestate(L);
+}
+
+static void test_board_placements(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    board_config_t config = { 10, 22, 20 };
+    board_t* board = board_new(&config);
+    assert_non_null(board);
+
+    int ok = luaL_dostring(L, "return {"
+        "cw = { { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } },"
+        "ccw = { { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } } }");
+    assert_true(ok == LUA_OK);
+    kicks_config_t* kicks = kicks_config_new(L, "test");
+    assert_non_null(kicks);
+
+    // Every column of every rotation on an empty board.
+    size_t count = 0;
+    board_placement_t* placements = board_find_placements(board, piece, kicks, &count);
+    assert_non_null(placements);
+    assert_true(count == 34);
+    free(placements);
+
+    // A T-spin double slot under an overhang is only reachable by rotating
+    // into it at the bottom.
+    test_fill_row(board, 19, "XXX..X....");
+    test_fill_row(board, 20, "XXX...XXXX");
+    test_fill_row(board, 21, "XXXX.XXXXX");
+    assert_false(board_test_piece(board, piece, vec2i(3, 18), 2));
+    placements = board_find_placements(board, piece, kicks, &count);
+    assert_non_null(placements);
+    bool found = false;
+    for (size_t i = 0;i < count;i++) {
+        if (placements[i].pos.x == 3 && placements[i].pos.y == 19 && placements[i].rot == 2) {
+            found = true;
+        }
+    }
+    assert_true(found);
+    free(placements);
+
+    board_delete(board);
+    kicks_config_delete(kicks);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_board_garbage(void** state) {
+    board_config_t config = { 10, 22, 20 };
+    board_t* board = board_new(&config);
+    assert_non_null(board);
+
+    // Garbage comes in from the bottom with a hole in it.
+    assert_true(board_push_garbage(board, 2, 3, 8));
+    assert_true(board->data.rows[21] == 0x3F7);
+    assert_true(board->data.rows[20] == 0x3F7);
+    assert_true(board_get(board, vec2i(0, 21)) == 8);
+    assert_true(board_get(board, vec2i(3, 21)) == 0);
+    assert_true(board_get_height(board, 0) == 2);
+    assert_true(board_get_height(board, 3) == 0);
+
+    // Outgoing attacks cancel the oldest pending garbage first.
+    assert_true(board_queue_garbage(board, 3, 1, 10));
+    assert_true(board_queue_garbage(board, 2, 5, 20));
+    assert_true(board_cancel_garbage(board, 4) == 0);
+    assert_true(board_get_garbage(board) == 1);
+
+    // Pending garbage waits until it's ready.
+    assert_true(board_insert_garbage(board, 15, 8, NULL) == 0);
+    bool overflow = true;
+    assert_true(board_insert_garbage(board, 20, 8, &overflow) == 1);
+    assert_false(overflow);
+    assert_true(board->data.rows[21] == 0x3DF);
+    assert_true(board->data.rows[20] == 0x3F7);
+    assert_true(board_get_garbage(board) == 0);
+    assert_true(board_cancel_garbage(board, 5) == 5);
+
+    // Attacks have to be queued in the order they become ready.
+    assert_true(board_queue_garbage(board, 1, 0, 30));
+    assert_false(board_queue_garbage(board, 1, 0, 25));
+    assert_true(board_queue_garbage(board, 1, 0, 30));
+    assert_true(board_get_garbage(board) == 2);
+    assert_true(board_insert_garbage(board, 30, 8, NULL) == 2);
+
+    // Pushing the stack off the top of the board is reported.
+    assert_false(board_push_garbage(board, 22, 0, 8));
+
+    // Only the rows that fit on the board are counted as inserted.
+    assert_true(board_queue_garbage(board, 30, 0, 40));
+    assert_true(board_insert_garbage(board, 40, 8, &overflow) == 22);
+    assert_true(overflow);
+
+    board_delete(board);
+}
+
+static void test_board_dirty(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    board_config_t config = { 10, 22, 20 };
+    board_t* board = board_new(&config);
+    assert_non_null(board);
+
+    // A new board is dirty all over.
+    assert_true(board_get_dirty(board) == 0x3FFFFF);
+    board_reset_dirty(board);
+    assert_true(board_get_dirty(board) == 0);
+    uint32_t seen = board_get_generation(board);
+
+    // Locking only dirties the rows of the piece.
+    board_lock_piece(board, piece, vec2i(0, 20), 0);
+    assert_true(board_get_dirty(board) == ((uint64_t)0x3 << 20));
+    assert_true(board_get_changed(board, seen) == ((uint64_t)0x3 << 20));
+    seen = board_get_generation(board);
+    assert_true(board_get_changed(board, seen) == 0);
+
+    // Clearing a line dirties everything above it.
+    board_lock_piece(board, piece, vec2i(3, 20), 0);
+    board_lock_piece(board, piece, vec2i(6, 20), 0);
+    board_lock_piece(board, piece, vec2i(8, 19), 3);
+    seen = board_get_generation(board);
+    board_reset_dirty(board);
+    assert_true(board_clear_lines(board, NULL) == 1);
+    assert_true(board_get_dirty(board) == 0x3FFFFF);
+    assert_true(board_get_changed(board, seen) == 0x3FFFFF);
+
+    board_delete(board);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_board_evaluate(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    entity_manager_t* manager = entity_manager_new();
+    assert_non_null(manager);
+    board_config_t config = { 10, 22, 20 };
+    entity_t* bentity = entity_manager_create(manager);
+    assert_non_null(bentity);
+    assert_true(board_entity_init(bentity, manager, &config));
+    board_t* board = bentity->data;
+    board_lock_piece(board, piece, vec2i(0, 20), 0);
+    board_lock_piece(board, piece, vec2i(4, 19), 2);
+
+    board_eval_t eval;
+    board_evaluate(board, &eval);
+    assert_true(eval.holes == 2);
+    assert_true(eval.covered == 2);
+    assert_true(eval.aggregate_height == 10);
+    assert_true(eval.max_height == 2);
+    assert_true(eval.bumpiness == 7);
+    assert_true(eval.row_transitions == 50);
+    assert_true(eval.column_transitions == 14);
+    assert_true(eval.well_sum == 2);
+    assert_true(eval.max_well == 1);
+
+    // Count the corners around a piece, where the walls count as occupied.
+    entity_t* pentity = entity_manager_create(manager);
+    assert_non_null(pentity);
+    assert_true(piece_entity_init(pentity, piece));
+    assert_true(board_count_corners(board, 0) == -1);
+    assert_true(board_set_piece(board, 0, pentity->id));
+    board->pieces[0].pos = vec2i(3, 19);
+    assert_true(board_count_corners(board, 0) == 1);
+    board->pieces[0].pos = vec2i(-1, 20);
+    assert_true(board_count_corners(board, 0) == 4);
+
+    entity_manager_delete(manager);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_board_hash(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    board_config_t config = { 10, 22, 20 };
+    board_t* board = board_new(&config);
+    assert_non_null(board);
+    board_t* other = board_new(&config);
+    assert_non_null(other);
+
+    // An empty board hashes to 0.
+    assert_true(board_get_hash(board) == 0);
+
+    // Boards with the same contents hash the same, however they got there.
+    board_lock_piece(board, piece, vec2i(0, 20), 0);
+    board_lock_piece(board, piece, vec2i(4, 20), 0);
+    board_lock_piece(other, piece, vec2i(4, 20), 0);
+    assert_true(board_get_hash(board) != board_get_hash(other));
+    board_lock_piece(other, piece, vec2i(0, 20), 0);
+    assert_true(board_get_hash(board) != 0);
+    assert_true(board_get_hash(board) == board_get_hash(other));
+
+    // Garbage that is cleared again leaves the hash where it was.
+    uint64_t hash = board_get_hash(board);
+    assert_true(board_push_garbage(board, 1, 10, 8));
+    assert_true(board_get_hash(board) != hash);
+    assert_true(board_clear_lines(board, NULL) == 1);
+    assert_true(board_get_hash(board) == hash);
+
+    board_delete(other);
+    board_delete(board);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_board_undo(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    board_config_t config = { 10, 22, 20 };
+    board_t* board = board_new(&config);
+    assert_non_null(board);
+    assert_true(board_push_garbage(board, 1, 1, 8));
+
+    board_t* clone = board_clone(board);
+    assert_non_null(clone);
+    assert_true(clone->id != board->id);
+    assert_true(board_get_hash(clone) == board_get_hash(board));
+
+    // Filling in the hole clears a line.
+    board_undo_t undo;
+    assert_true(board_apply_placement(board, piece, vec2i(0, 19), 2, &undo));
+    assert_true(undo.lines == 1);
+    assert_true(undo.cleared == ((uint64_t)1 << 21));
+    assert_true(board->data.rows[21] == 0x7);
+    assert_true(board_get_hash(board) != board_get_hash(clone));
+
+    // Undoing it puts everything back the way it was.
+    board_undo_placement(board, &undo);
+    assert_memory_equal(board->data.data, clone->data.data, board->data.size);
+    assert_memory_equal(board->data.rows, clone->data.rows, 22 * sizeof(rowmask_t));
+    assert_memory_equal(board->data.heights, clone->data.heights, 10 * sizeof(int16_t));
+    assert_memory_equal(board->data.wells, clone->data.wells, 10 * sizeof(int16_t));
+    assert_true(board_get_hash(board) == board_get_hash(clone));
+
+    board_delete(clone);
+    board_delete(board);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_board_serialize(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    entity_manager_t* manager = entity_manager_new();
+    assert_non_null(manager);
+
+    // Unserializing a board finds the entity manager in the registry.
+    lua_newtable(L); // push registry table
+    lua_pushlightuserdata(L, manager);
+    lua_setfield(L, -2, "entity_manager");
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX); // pop registry table
+    serialize_t ser = { L, ref };
+
+    board_config_t config = { 10, 22, 20 };
+    entity_t* entity = entity_manager_create(manager);
+    assert_non_null(entity);
+    assert_true(board_entity_init(entity, manager, &config));
+    board_t* board = entity->data;
+    board_lock_piece(board, piece, vec2i(0, 20), 0);
+    board_lock_piece(board, piece, vec2i(4, 19), 2);
+    assert_true(board_push_garbage(board, 2, 3, 8));
+    assert_true(board_queue_garbage(board, 1, 5, 100));
+
+    // Most of the board is empty, so it should take up very little room.
+    buffer_t* serialized = entity_serialize(entity);
+    assert_non_null(serialized);
+    assert_true(serialized->size < board->data.size / 2);
+
+    entity_t copy;
+    assert_true(entity_unserialize(&copy, &ser, serialized));
+    assert_true(copy.id == entity->id);
+    board_t* other = copy.data;
+    assert_true(other->manager == manager);
+    assert_true(other->config.width == 10 && other->config.height == 22);
+    assert_memory_equal(other->data.data, board->data.data, board->data.size);
+    assert_memory_equal(other->data.rows, board->data.rows, 22 * sizeof(rowmask_t));
+    assert_memory_equal(other->data.heights, board->data.heights, 10 * sizeof(int16_t));
+    assert_true(board_get_hash(other) == board_get_hash(board));
+    assert_true(board_get_garbage(other) == 1);
+
+    entity_deinit(&copy);
+    buffer_delete(serialized);
+    entity_manager_delete(manager);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_board_rotate(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    piece_config_t* piece = test_t_piece(L);
+    int ok = luaL_dostring(L, "return {"
+        "cw = { { 0, 0, -1, 0 }, { 0, 0, 1, 0 }, { 0, 0, 1, 0 }, { 0, 0, -1, 0 } },"
+        "ccw = { { 0, 0, 1, 0 }, { 0, 0, 1, 0 }, { 0, 0, -1, 0 }, { 0, 0, -1, 0 } } }");
+    assert_true(ok == LUA_OK);
+    kicks_config_t* kicks = kicks_config_new(L, "test");
+    assert_non_null(kicks);
+
+    entity_manager_t* manager = entity_manager_new();
+    assert_non_null(manager);
+    board_config_t config = { 10, 22, 20 };
+    entity_t* bentity = entity_manager_create(manager);
+    assert_non_null(bentity);
+    assert_true(board_entity_init(bentity, manager, &config));
+    board_t* board = bentity->data;
+    entity_t* pentity = entity_manager_create(manager);
+    assert_non_null(pentity);
+    assert_true(piece_entity_init(pentity, piece));
+    piece->kicks = kicks;
+
+    // Rotating in open space doesn't move the piece.
+    assert_true(board_set_piece(board, 0, pentity->id));
+    assert_true(board_rotate_piece(board, 0, MINO_ROTATE_CW));
+    assert_true(board->pieces[0].rot == 1);
+    assert_true(board->pieces[0].pos.x == 3 && board->pieces[0].pos.y == 1);
+
+    // Rotating against the left wall kicks the piece right.
+    board->pieces[0].pos = vec2i(-1, 1);
+    assert_true(board_rotate_piece(board, 0, MINO_ROTATE_CCW));
+    assert_true(board->pieces[0].rot == 0);
+    assert_true(board->pieces[0].pos.x == 0 && board->pieces[0].pos.y == 1);
+
+    entity_manager_delete(manager);
+    kicks_config_delete(kicks);
+    piece_config_delete(piece);
+    script_closestate(L);
+}
+
+static void test_piece_config_invalid(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    // Data that doesn't hold a whole number of rotations.
+    int ok = luaL_dostring(L, "return { data = { 9, 9, 9, 9, 9 },"
+        "spawn_pos = { x = 4, y = 1 }, spawn_rot = 0, width = 2, height = 2 }");
+    assert_true(ok == LUA_OK);
+    assert_null(piece_config_new(L, "bad_piece"));
+    lua_pop(L, 1);
+
+    // No rotations at all.
+    ok = luaL_dostring(L, "return { data = { },"
+        "spawn_pos = { x = 4, y = 1 }, spawn_rot = 0, width = 2, height = 2 }");
+    assert_true(ok == LUA_OK);
+    assert_null(piece_config_new(L, "bad_piece"));
+    lua_pop(L, 1);
+
+    // Spawn rotation past the last rotation.
+    ok = luaL_dostring(L, "return { data = { 9, 9, 9, 9 },"
+        "spawn_pos = { x = 4, y = 1 }, spawn_rot = 1, width = 2, height = 2 }");
+    assert_true(ok == LUA_OK);
+    assert_null(piece_config_new(L, "bad_piece"));
+    lua_pop(L, 1);
+
+    script_closestate(L);
+}
+
+static void test_boardscript_placements(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    environment_t* env = environment_new(L, "stdmino", "endurance");
+    assert_non_null(env);
+
+    // Kicks that never find room, so the piece can't rotate at all.
+    bool ok = environment_dostring(env, "mino_proto.load('kicks', 'test_blocked', {"
+        "cw = { { 0, -100 }, { 0, -100 }, { 0, -100 }, { 0, -100 } },"
+        "ccw = { { 0, -100 }, { 0, -100 }, { 0, -100 }, { 0, -100 } } })");
+    assert_true(ok == true);
+
+    ok = environment_dostring(env, "local board = mino_board.create('normal')\n"
+        "default_count = #mino_board.find_placements(board, 't_piece')\n"
+        "kicks_count = #mino_board.find_placements(board, 't_piece', 'test_blocked')");
+    assert_true(ok == true);
+
+    // On an empty board every rotation is reachable with the default kicks,
+    // while the blocked kicks leave only the spawn rotation.
+    assert_true(test_env_integer(env, "default_count") == 34);
+    assert_true(test_env_integer(env, "kicks_count") == 8);
+
+    // Kicks of the wrong type are an error, not silently ignored.
+    ok = environment_dostring(env, "local board = mino_board.create('normal')\n"
+        "mino_board.find_placements(board, 't_piece', 'normal')");
+    assert_true(ok == false);
+
+    environment_delete(env);
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+static void test_boardscript_rows(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    environment_t* env = environment_new(L, "stdmino", "endurance");
+    assert_non_null(env);
+
+    // An O piece in the bottom left corner fills columns 1 and 2 of the
+    // bottom two rows.
+    bool ok = environment_dostring(env, "board = mino_board.create('normal')\n"
+        "mino_board.lock_piece(board, 'o_piece', { x = 0, y = 20 }, 0)");
+    assert_true(ok == true);
+
+    // Size of the board
+    ok = environment_dostring(env,
+        "width, height, visible_height = mino_board.get_size(board)");
+    assert_true(ok == true);
+    assert_true(test_env_integer(env, "width") == 10);
+    assert_true(test_env_integer(env, "height") == 22);
+    assert_true(test_env_integer(env, "visible_height") == 20);
+
+    // Occupancy of a range of rows, and of the whole board
+    ok = environment_dostring(env, "local rows = mino_board.rows(board, 19, 21)\n"
+        "rows_count = #rows\n"
+        "rows_empty, rows_first, rows_last = rows[1], rows[2], rows[3]\n"
+        "all_count = #mino_board.rows(board)");
+    assert_true(ok == true);
+    assert_true(test_env_integer(env, "rows_count") == 3);
+    assert_true(test_env_integer(env, "rows_empty") == 0);
+    assert_true(test_env_integer(env, "rows_first") == 6);
+    assert_true(test_env_integer(env, "rows_last") == 6);
+    assert_true(test_env_integer(env, "all_count") == 22);
+
+    // Contents of a range of rows, and of the whole board
+    ok = environment_dostring(env, "local dump = mino_board.dump(board, 20, 21)\n"
+        "dump_len = #dump\n"
+        "dump_empty = string.byte(dump, 1)\n"
+        "dump_first = string.byte(dump, 2)\n"
+        "dump_last = string.byte(dump, 13)\n"
+        "dump_all = #mino_board.dump(board)");
+    assert_true(ok == true);
+    assert_true(test_env_integer(env, "dump_len") == 20);
+    assert_true(test_env_integer(env, "dump_empty") == 0);
+    assert_true(test_env_integer(env, "dump_first") == 5);
+    assert_true(test_env_integer(env, "dump_last") == 5);
+    assert_true(test_env_integer(env, "dump_all") == 220);
+
+    // Row ranges outside of the board error out.
+    ok = environment_dostring(env, "mino_board.rows(board, 22)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.dump(board, 5, 4)");
+    assert_true(ok == false);
+
+    environment_delete(env);
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+static void test_boardscript_xy(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    environment_t* env = environment_new(L, "stdmino", "endurance");
+    assert_non_null(env);
+
+    // Locking by vector and by x and y lands in the same place.
+    bool ok = environment_dostring(env, "board = mino_board.create('normal')\n"
+        "mino_board.lock_piece(board, 'o_piece', { x = 0, y = 20 }, 0)\n"
+        "local other = mino_board.create('normal')\n"
+        "mino_board.lock_piece_xy(other, 'o_piece', 0, 20, 0)\n"
+        "same_lock = mino_board.dump(board) == mino_board.dump(other)");
+    assert_true(ok == true);
+    assert_true(test_env_boolean(env, "same_lock"));
+
+    // Cell lookups
+    ok = environment_dostring(env,
+        "same_get_full = mino_board.get(board, { x = 1, y = 21 }) == mino_board.get_xy(board, 1, 21)\n"
+        "same_get_empty = mino_board.get(board, { x = 5, y = 21 }) == mino_board.get_xy(board, 5, 21)");
+    assert_true(ok == true);
+    assert_true(test_env_boolean(env, "same_get_full"));
+    assert_true(test_env_boolean(env, "same_get_empty"));
+
+    // Piece positions
+    ok = environment_dostring(env, "piece = mino_piece.create('t_piece')\n"
+        "mino_board.set_piece(board, 1, piece)\n"
+        "local spawn = mino_piece.config_spawn_pos(piece)\n"
+        "local sx, sy = mino_piece.config_spawn_pos_xy(piece)\n"
+        "same_spawn = spawn.x == sx and spawn.y == sy\n"
+        "mino_board.set_pos(board, 1, { x = 4, y = 5 })\n"
+        "local px, py = mino_board.get_pos_xy(board, 1)\n"
+        "same_set_pos = px == 4 and py == 5\n"
+        "mino_board.set_pos_xy(board, 1, 2, 7)\n"
+        "local pos = mino_board.get_pos(board, 1)\n"
+        "same_set_pos_xy = pos.x == 2 and pos.y == 7");
+    assert_true(ok == true);
+    assert_true(test_env_boolean(env, "same_spawn"));
+    assert_true(test_env_boolean(env, "same_set_pos"));
+    assert_true(test_env_boolean(env, "same_set_pos_xy"));
+
+    // Collision queries, both against the locked piece and in open space
+    ok = environment_dostring(env,
+        "local blocked = mino_board.test_piece(board, 't_piece', { x = 0, y = 19 }, 0)\n"
+        "same_test_blocked = blocked == mino_board.test_piece_xy(board, 't_piece', 0, 19, 0)\n"
+        "local open = mino_board.test_piece(board, 't_piece', { x = 4, y = 19 }, 0)\n"
+        "same_test_open = open == mino_board.test_piece_xy(board, 't_piece', 4, 19, 0)\n"
+        "same_test_differs = blocked ~= open\n"
+        "local drop = mino_board.drop_distance(board, 't_piece', { x = 0, y = 0 }, 0)\n"
+        "same_drop = drop == mino_board.drop_distance_xy(board, 't_piece', 0, 0, 0)\n"
+        "local stop = mino_board.test_piece_between(board, 't_piece', { x = 0, y = 0 }, 0, { x = 0, y = 21 })\n"
+        "local bx, by = mino_board.test_piece_between_xy(board, 't_piece', 0, 0, 0, 0, 21)\n"
+        "same_between = stop.x == bx and stop.y == by");
+    assert_true(ok == true);
+    assert_true(test_env_boolean(env, "same_test_blocked"));
+    assert_true(test_env_boolean(env, "same_test_open"));
+    assert_true(test_env_boolean(env, "same_test_differs"));
+    assert_true(test_env_boolean(env, "same_drop"));
+    assert_true(test_env_boolean(env, "same_between"));
+
+    // Anything other than two integers is an error.
+    ok = environment_dostring(env, "mino_board.get_xy(board, 'a', 21)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.get_xy(board, 1)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.get_xy(board, { x = 1, y = 21 })");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.set_pos_xy(board, 1, 2.5, 7)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.test_piece_xy(board, 't_piece', { x = 0, y = 0 }, 0)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.lock_piece_xy(board, 'o_piece', 0, nil, 0)");
+    assert_true(ok == false);
+
+    // So is a rotation the piece doesn't have.
+    ok = environment_dostring(env, "mino_board.test_piece(board, 't_piece', { x = 4, y = 0 }, 4)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.drop_distance_xy(board, 't_piece', 4, 0, -1)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.lock_piece(board, 'o_piece', { x = 4, y = 0 }, 4)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.set_rot(board, 1, 4)");
+    assert_true(ok == false);
+
+    // Garbage needs a block value that can be drawn.
+    ok = environment_dostring(env, "mino_board.push_garbage(board, 1, 0, 0)");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.insert_garbage(board, 0, 256)");
+    assert_true(ok == false);
+
+    environment_delete(env);
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_board_collision),
+        cmocka_unit_test(test_board_config),
+        cmocka_unit_test(test_board_placements),
+        cmocka_unit_test(test_board_garbage),
+        cmocka_unit_test(test_board_dirty),
+        cmocka_unit_test(test_board_evaluate),
+        cmocka_unit_test(test_board_hash),
+        cmocka_unit_test(test_board_undo),
+        cmocka_unit_test(test_board_serialize),
+        cmocka_unit_test(test_board_rotate),
+        cmocka_unit_test(test_piece_config_invalid),
+        cmocka_unit_test(test_boardscript_placements),
+        cmocka_unit_test(test_boardscript_rows),
+        cmocka_unit_test(test_boardscript_xy),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, test_entity_teardown);
+}
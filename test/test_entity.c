@@ -61,10 +61,72 @@ static void test_entity_manager(void** state) {
     assert_true(error_count() == 0);
 }
 
+static void test_entity_pool(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    entity_manager_t* manager = entity_manager_new();
+    assert_non_null(manager);
+
+    entity_pool_stats_t before;
+    entity_pool_get_stats(MINO_ENTITY_NONE, &before);
+
+    // Entities come out of the pool
+    entity_t* entities[100];
+    for (size_t i = 0;i < 100;i++) {
+        entities[i] = entity_manager_create(manager);
+        assert_non_null(entities[i]);
+    }
+
+    entity_pool_stats_t stats;
+    entity_pool_get_stats(MINO_ENTITY_NONE, &stats);
+    assert_true(stats.size >= sizeof(entity_t));
+    assert_int_equal(stats.used, before.used + 100);
+    assert_true(stats.capacity >= stats.used);
+    assert_true(stats.slabs > 0);
+
+    // Destroyed entities go back to the pool, and are reused without
+    // growing it
+    for (size_t i = 0;i < 100;i++) {
+        entity_manager_destroy(manager, entities[i]->id);
+    }
+    entity_pool_get_stats(MINO_ENTITY_NONE, &stats);
+    assert_int_equal(stats.used, before.used);
+
+    size_t slabs = stats.slabs;
+    for (size_t i = 0;i < 100;i++) {
+        entities[i] = entity_manager_create(manager);
+        assert_non_null(entities[i]);
+        assert_null(entities[i]->data);
+    }
+    entity_pool_get_stats(MINO_ENTITY_NONE, &stats);
+    assert_int_equal(stats.slabs, slabs);
+
+    // Every block of a type's pool has the same size
+    void* payload = entity_pool_alloc(MINO_ENTITY_RANDOM, 8);
+    assert_non_null(payload);
+    entity_pool_get_stats(MINO_ENTITY_RANDOM, &stats);
+    assert_null(entity_pool_alloc(MINO_ENTITY_RANDOM, stats.size + 1));
+    assert_non_null(error_pop());
+    entity_pool_free(MINO_ENTITY_RANDOM, payload);
+
+    entity_manager_delete(manager);
+    entity_pool_get_stats(MINO_ENTITY_NONE, &stats);
+    assert_int_equal(stats.used, before.used);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+
+    assert_true(error_count() == 0);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_entity_manager),
+        cmocka_unit_test(test_entity_pool),
     };
 
-    return cmocka_run_group_tests(tests, NULL, NULL);
+    return cmocka_run_group_tests(tests, NULL, test_entity_teardown);
 }
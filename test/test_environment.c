@@ -38,7 +38,7 @@ static void test_environment(void** state) {
     assert_true(ok == true);
 
     environment_delete(env);
-    lua_close(L);
+    script_closestate(L);
 
     vfs_deinit();
     platform_deinit();
@@ -47,10 +47,47 @@ static void test_environment(void** state) {
     assert_true(error_count() == 0);
 }
 
+/**
+ * Running frames without a frontend must still collect garbage.
+ */
+static void test_environment_gc(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    environment_t* env = environment_new(L, "stdmino", "endurance");
+    assert_non_null(env);
+
+    bool ok = environment_start(env);
+    assert_true(ok == true);
+
+    const script_gc_t* gc = script_get_gc(L);
+    assert_non_null(gc);
+    assert_true(gc->collections == 0);
+
+    // Nobody calls script_gc_step, so the environment has to.
+    playerinputs_t inputs = { 0 };
+    for (int i = 0;i < 120;i++) {
+        environment_frame(env, &inputs);
+    }
+    assert_true(gc->collections > 0);
+
+    environment_delete(env);
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_environment),
+        cmocka_unit_test(test_environment_gc),
     };
 
-    return cmocka_run_group_tests(tests, NULL, NULL);
+    return cmocka_run_group_tests(tests, NULL, test_entity_teardown);
 }
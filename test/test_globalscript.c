@@ -37,7 +37,7 @@ static void test_globalscript_doconfig(void** state) {
     lua_pop(L, 1); // pop pieces table
 
     environment_delete(env);
-    lua_close(L);
+    script_closestate(L);
 
     vfs_deinit();
     platform_deinit();
@@ -49,5 +49,5 @@ int main(void) {
         cmocka_unit_test(test_globalscript_doconfig),
     };
 
-    return cmocka_run_group_tests(tests, NULL, NULL);
+    return cmocka_run_group_tests(tests, NULL, test_entity_teardown);
 }
@@ -0,0 +1,84 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "test.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "input.h"
+#include "inputscript.h"
+#include "platform.h"
+#include "script.h"
+#include "vfs.h"
+
+/**
+ * Call a method of the inputs userdata on top of the stack for the first
+ * player and return the integer result.
+ */
+static lua_Integer call_method(lua_State* L, const char* method) {
+    lua_getfield(L, -1, method);
+    lua_pushvalue(L, -2);
+    lua_pushinteger(L, 1);
+    assert_int_equal(lua_pcall(L, 2, 1, 0), LUA_OK);
+    lua_Integer result = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return result;
+}
+
+static void test_inputs(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    inputscript_inputs_t* ud = inputscript_push_new_inputs(L);
+    assert_non_null(ud);
+    assert_int_equal(call_method(L, "mask"), 0);
+
+    // Holding left and hold is a press of both
+    playerinputs_t inputs = { 0 };
+    inputs.inputs[0] = INPUT_LEFT | INPUT_HOLD;
+    inputscript_update_inputs(ud, &inputs);
+    assert_int_equal(call_method(L, "mask"), INPUT_LEFT | INPUT_HOLD);
+    assert_int_equal(call_method(L, "pressed"), INPUT_LEFT | INPUT_HOLD);
+    assert_int_equal(call_method(L, "released"), 0);
+
+    // Keeping left held and letting go of hold is only a release
+    inputs.inputs[0] = INPUT_LEFT;
+    inputscript_update_inputs(ud, &inputs);
+    assert_int_equal(call_method(L, "mask"), INPUT_LEFT);
+    assert_int_equal(call_method(L, "pressed"), 0);
+    assert_int_equal(call_method(L, "released"), INPUT_HOLD);
+
+    // The module has the input bits, and pressed can be narrowed by a mask
+    inputs.inputs[0] = INPUT_LEFT | INPUT_CW | INPUT_180;
+    inputscript_update_inputs(ud, &inputs);
+    lua_setglobal(L, "inputs");
+    assert_int_equal(luaL_dostring(L,
+        "return inputs:pressed(1, mino_input.CW | mino_input.LEFT)"), LUA_OK);
+    assert_int_equal(lua_tointeger(L, -1), INPUT_CW);
+    lua_pop(L, 1);
+    assert_int_equal(luaL_dostring(L,
+        "return inputs:check_180(1) and inputs:mask(2) == 0"), LUA_OK);
+    assert_true(lua_toboolean(L, -1));
+    lua_pop(L, 1);
+
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_inputs),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
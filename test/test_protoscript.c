@@ -47,6 +47,16 @@ static void test_protoscript_load(void** state) {
     ok = environment_dostring(env, "mino_proto.load('piece', 'empty', {})");
     assert_true(ok == false);
 
+    // Does a proper board work?
+    ok = environment_dostring(env, "mino_proto.load('board', 'test_board', {"
+        "width = 10, height = 42, visible_height = 40 })");
+    assert_true(ok == true);
+
+    // Does a board that's too wide error out cleanly?
+    ok = environment_dostring(env, "mino_proto.load('board', 'wide', {"
+        "width = 100, height = 22 })");
+    assert_true(ok == false);
+
     // Does the piece we push into the protype container actually work?
     lua_rawgeti(L, LUA_REGISTRYINDEX, env->registry_ref);
     lua_getfield(L, -1, "proto_hash");
@@ -59,8 +69,20 @@ static void test_protoscript_load(void** state) {
     assert_true(piece->spawn_pos.x == 3);
     assert_true(piece->spawn_pos.y == 1);
 
+    // Is the handle of the piece the one that finds it in the container?
+    assert_true(piece->proto_handle != 0);
+    assert_true(proto_container_get(env->protos, piece->proto_handle - 1) == proto);
+
+    // Can prototypes be used by handle as well as by name?
+    ok = environment_dostring(env, "mino_board.create(mino_proto.get('test_board'))");
+    assert_true(ok == true);
+    ok = environment_dostring(env, "mino_board.create(mino_proto.get('test'))");
+    assert_true(ok == false);
+    ok = environment_dostring(env, "mino_board.create(12345)");
+    assert_true(ok == false);
+
     environment_delete(env);
-    lua_close(L);
+    script_closestate(L);
 
     vfs_deinit();
     platform_deinit();
@@ -72,5 +94,5 @@ int main(void) {
         cmocka_unit_test(test_protoscript_load),
     };
 
-    return cmocka_run_group_tests(tests, NULL, NULL);
+    return cmocka_run_group_tests(tests, NULL, test_entity_teardown);
 }
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "test.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "board.h"
+#include "entity.h"
+#include "piece.h"
+#include "rules.h"
+#include "script.h"
+
+typedef struct {
+    entity_manager_t* manager;
+    piece_config_t* piece;
+    int events[RULES_EVENT_MAX];
+} test_hooks_t;
+
+static piece_config_t* test_t_piece(lua_State* L) {
+    int ok = luaL_dostring(L, "return {"
+        "data = { 0, 9, 0, 9, 9, 9, 0, 0, 0,"
+                 "0, 9, 0, 0, 9, 9, 0, 9, 0,"
+                 "0, 0, 0, 9, 9, 9, 0, 9, 0,"
+                 "0, 9, 0, 9, 9, 0, 0, 9, 0 },"
+        "spawn_pos = { x = 3, y = 1 }, spawn_rot = 0, width = 3, height = 3 }");
+    assert_true(ok == LUA_OK);
+
+    piece_config_t* piece = piece_config_new(L, "t_piece");
+    assert_non_null(piece);
+    return piece;
+}
+
+static handle_t test_next_piece(void* data, rules_t* rules) {
+    test_hooks_t* hooks = data;
+    entity_t* entity = entity_manager_create(hooks->manager);
+    assert_non_null(entity);
+    assert_true(piece_entity_init(entity, hooks->piece));
+    return entity->id;
+}
+
+static void test_event(void* data, rules_t* rules, rules_event_t event, int value) {
+    test_hooks_t* hooks = data;
+    hooks->events[event] += 1;
+}
+
+static void test_rules_frame(void** state) {
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    test_hooks_t data = { 0 };
+    data.piece = test_t_piece(L);
+    data.manager = entity_manager_new();
+    assert_non_null(data.manager);
+    rules_hooks_t hooks = { test_next_piece, test_event, &data };
+
+    board_config_t config = { 10, 22, 20 };
+    entity_t* bentity = entity_manager_create(data.manager);
+    assert_non_null(bentity);
+    assert_true(board_entity_init(bentity, data.manager, &config));
+    board_t* board = bentity->data;
+
+    rules_config_t rules_config;
+    rules_config_init(&rules_config);
+    entity_t* rentity = entity_manager_create(data.manager);
+    assert_non_null(rentity);
+    assert_true(rules_entity_init(rentity, data.manager, bentity->id, &rules_config));
+    rules_t* rules = rentity->data;
+
+    // The first tic spawns a piece.
+    uint32_t tic = 1;
+    assert_true(rules_frame(rules, tic++, 0, &hooks));
+    assert_int_equal(data.events[RULES_EVENT_SPAWN], 1);
+    assert_true(board->pieces[0].pos.x == 3 && board->pieces[0].pos.y == 1);
+
+    // Hard drop locks the piece on the floor right away, and holding it
+    // down doesn't drop the next piece too.
+    assert_true(rules_frame(rules, tic++, INPUT_HARDDROP, &hooks));
+    assert_int_equal(data.events[RULES_EVENT_LOCK], 1);
+    assert_true(board->pieces[0].handle == handle_empty());
+    assert_true(board->data.rows[20] == 0x10 && board->data.rows[21] == 0x38);
+    assert_true(rules_frame(rules, tic++, INPUT_HARDDROP, &hooks));
+    assert_int_equal(data.events[RULES_EVENT_SPAWN], 2);
+    assert_int_equal(data.events[RULES_EVENT_LOCK], 1);
+
+    // Hold swaps in the next piece, but only once per piece.
+    handle_t held = board->pieces[0].handle;
+    assert_true(rules_frame(rules, tic++, INPUT_HOLD, &hooks));
+    assert_true(rules->hold == held);
+    assert_int_equal(data.events[RULES_EVENT_HOLD], 1);
+    assert_true(rules_frame(rules, tic++, INPUT_HOLD, &hooks));
+    assert_int_equal(data.events[RULES_EVENT_HOLD], 1);
+
+    // Holding left moves once, then waits out DAS before shifting again.
+    for (int i = 0;i < 16;i++) {
+        assert_true(rules_frame(rules, tic++, INPUT_LEFT, &hooks));
+    }
+    assert_int_equal(data.events[RULES_EVENT_MOVE], 3);
+    assert_int_equal(board->pieces[0].pos.x, 0);
+
+    // Rotation only happens on the first tic of a press.
+    assert_true(rules_frame(rules, tic++, INPUT_CW, &hooks));
+    assert_true(rules_frame(rules, tic++, INPUT_CW, &hooks));
+    assert_int_equal(board->pieces[0].rot, 1);
+    assert_int_equal(data.events[RULES_EVENT_ROTATE], 1);
+
+    // With nowhere to spawn, the game is over.
+    for (int y = 0;y < config.height;y++) {
+        board->data.rows[y] = 0x3FE;
+    }
+    assert_true(board_unset_piece(board, 0));
+    assert_false(rules_frame(rules, tic++, 0, &hooks));
+    assert_int_equal(data.events[RULES_EVENT_SPAWN_FAIL], 1);
+
+    entity_manager_delete(data.manager);
+    piece_config_delete(data.piece);
+    script_closestate(L);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_rules_frame),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, test_entity_teardown);
+}
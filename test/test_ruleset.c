@@ -20,7 +20,7 @@ static void test_ruleset_new(void** state) {
     assert_non_null(ruleset);
     ruleset_delete(ruleset);
 
-    lua_close(L);
+    script_closestate(L);
     vfs_deinit();
     platform_deinit();
     frontend_deinit();
@@ -10,6 +10,7 @@
 
 #include "platform.h"
 #include "script.h"
+#include "scriptalloc.h"
 #include "vfs.h"
 
 /**
@@ -20,6 +21,15 @@ static int first_upvalue(lua_State* L) {
     return 1;
 }
 
+/**
+ * A lua cfunction that checks an x and y pair and pushes it back.
+ */
+static int echo_xy(lua_State* L) {
+    vec2i_t vec = script_check_xy(L, 1);
+    script_push_xy(L, &vec);
+    return 2;
+}
+
 static void test_wrap_cfuncs(void** state) {
     frontend_init(&g_frontend_module);
     platform_init();
@@ -43,7 +53,188 @@ static void test_wrap_cfuncs(void** state) {
     luaL_dostring(L, "return mino_test.first_upvalue()");
     assert_string_equal("_ENV", lua_tostring(L, -1));
 
-    lua_close(L);
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+static void test_xy(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    lua_pushcfunction(L, echo_xy);
+    lua_setglobal(L, "echo_xy");
+
+    // Integers come back out in the same order
+    assert_int_equal(luaL_dostring(L, "return echo_xy(3, -4)"), LUA_OK);
+    assert_int_equal(lua_gettop(L), 2);
+    assert_int_equal(lua_tointeger(L, -2), 3);
+    assert_int_equal(lua_tointeger(L, -1), -4);
+    lua_pop(L, 2);
+
+    // Anything that isn't an integer is an error
+    assert_int_not_equal(luaL_dostring(L, "return echo_xy('a', 4)"), LUA_OK);
+    lua_pop(L, 1);
+    assert_int_not_equal(luaL_dostring(L, "return echo_xy(3)"), LUA_OK);
+    lua_pop(L, 1);
+    assert_int_not_equal(luaL_dostring(L, "return echo_xy(3, 4.5)"), LUA_OK);
+    lua_pop(L, 1);
+    assert_int_not_equal(luaL_dostring(L, "return echo_xy({ x = 3, y = 4 })"), LUA_OK);
+    lua_pop(L, 1);
+
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+static void test_load_chunk(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    const char* embedded = "gametype/stdmino/endurance/gametype.lua";
+    char garbage[] = "this is not a lua script";
+
+#ifdef TEST_PRECOMPILED_LUA
+    // The in-binary resource pack carries a chunk that loads as bytecode
+    vfile_t* compiled = vfs_vfile_new_compiled(embedded);
+    assert_non_null(compiled);
+    assert_int_equal(luaL_loadbufferx(L, (char*)compiled->data, compiled->size,
+                                      embedded, "b"), LUA_OK);
+    lua_pop(L, 1);
+    vfs_vfile_delete(compiled);
+
+    // A script served by the pack loads its chunk, not its source
+    vfile_t trusted = { (char*)embedded, (uint8_t*)garbage, sizeof(garbage) - 1 };
+    assert_int_equal(script_load_chunk(L, &trusted), LUA_OK);
+    lua_pop(L, 1);
+#endif
+
+    // Nothing outside of the pack has a trusted chunk
+    assert_null(vfs_vfile_new_compiled("untrusted.lua"));
+    vfile_t untrusted = { "untrusted.lua", (uint8_t*)garbage, sizeof(garbage) - 1 };
+    assert_int_not_equal(script_load_chunk(L, &untrusted), LUA_OK);
+    lua_pop(L, 1);
+
+    // Bytecode from any other source is refused
+    assert_int_equal(luaL_dostring(L,
+        "return string.dump(function() return 1 end)"), LUA_OK);
+    size_t size = 0;
+    const char* bytecode = lua_tolstring(L, -1, &size);
+    assert_non_null(bytecode);
+    untrusted.data = (uint8_t*)bytecode;
+    untrusted.size = size;
+    assert_int_not_equal(script_load_chunk(L, &untrusted), LUA_OK);
+    lua_pop(L, 2);
+
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+static void test_alloc_accounts(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+    scriptalloc_t* alloc = scriptalloc_from_state(L);
+    assert_non_null(alloc);
+
+    // Allocations made while an account is active are charged to it
+    uint32_t account = scriptalloc_open_account(alloc, 0);
+    assert_int_not_equal(account, SCRIPTALLOC_STATE_ACCOUNT);
+    uint32_t previous = scriptalloc_switch_account(alloc, account);
+    assert_int_equal(previous, SCRIPTALLOC_STATE_ACCOUNT);
+    assert_int_equal(luaL_dostring(L, "big = string.rep('x', 4096)"), LUA_OK);
+    scriptalloc_switch_account(alloc, previous);
+
+    const scriptalloc_account_t* info = scriptalloc_get_account(alloc, account);
+    assert_non_null(info);
+    assert_true(info->bytes >= 4096);
+    assert_true(info->peak >= info->bytes);
+    assert_true(info->blocks > 0);
+
+    // Going over the limit is a memory error, and nothing is charged for it
+    scriptalloc_set_limit(alloc, account, info->bytes + 1024);
+    size_t before = info->bytes;
+    scriptalloc_switch_account(alloc, account);
+    assert_int_equal(luaL_dostring(L, "huge = string.rep('x', 65536)"), LUA_ERRMEM);
+    scriptalloc_switch_account(alloc, previous);
+    assert_true(info->bytes <= before + 1024);
+    lua_pop(L, 1);
+
+    // Blocks from outside of Lua can be charged too, within the limit
+    before = info->bytes;
+    scriptalloc_set_limit(alloc, account, before + 1024);
+    assert_false(scriptalloc_charge_block(alloc, account, 4096));
+    assert_int_equal(info->bytes, before);
+    assert_true(scriptalloc_charge_block(alloc, account, 512));
+    assert_int_equal(info->bytes, before + 512);
+    scriptalloc_credit_block(alloc, account, 512);
+    assert_int_equal(info->bytes, before);
+
+    // Once closed, the account stops counting what it left behind
+    scriptalloc_close_account(alloc, account);
+    assert_int_equal(luaL_dostring(L, "big = nil; collectgarbage()"), LUA_OK);
+
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+static void test_gc_step(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    // Make plenty of garbage while the collector can't run on its own
+    bool running = script_gc_stop(L);
+    assert_true(running);
+    assert_int_equal(luaL_dostring(L,
+        "for i = 1, 10000 do local t = { i, tostring(i) } end"), LUA_OK);
+    int before = lua_gc(L, LUA_GCCOUNT, 0);
+
+    // Stepping by hand with a generous budget finishes cycles, and the
+    // second one is sure to have started after the garbage was made
+    script_gc_t gc = { 0 };
+    for (int i = 0; i < 1000 && gc.cycles < 2; i++) {
+        script_gc_step(L, &gc, 1000.0);
+    }
+    assert_true(gc.cycles >= 2);
+    assert_true(gc.collections > 0);
+    assert_true(gc.steps >= gc.collections);
+    assert_true(gc.heap < before);
+    assert_true(gc.longest_ms >= gc.last_ms);
+
+    // Nothing has been allocated since, so there is no point starting another
+    uint32_t steps = gc.steps;
+    script_gc_step(L, &gc, 1000.0);
+    assert_int_equal(gc.steps, steps);
+
+    script_gc_restart(L, running);
+    assert_true(lua_gc(L, LUA_GCISRUNNING, 0) != 0);
+
+    script_closestate(L);
 
     vfs_deinit();
     platform_deinit();
@@ -53,6 +244,10 @@ static void test_wrap_cfuncs(void** state) {
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_wrap_cfuncs),
+        cmocka_unit_test(test_xy),
+        cmocka_unit_test(test_load_chunk),
+        cmocka_unit_test(test_alloc_accounts),
+        cmocka_unit_test(test_gc_step),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,91 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "platform.h"
+#include "script.h"
+#include "scriptprof.h"
+#include "vfs.h"
+
+static void test_profile(void** state) {
+    frontend_init(&g_frontend_module);
+    platform_init();
+    assert_true(vfs_init(NULL) == true);
+
+    lua_State* L = script_newstate();
+    assert_non_null(L);
+
+    scriptprof_t* prof = scriptprof_new(L, 100);
+    assert_non_null(prof);
+
+    // Calls into our bindings are counted even if they fail
+    scriptprof_start(prof);
+    int ok = luaL_dostring(L,
+        "local function busy(n) local x = 0 for i = 1, n do x = x + i end return x end\n"
+        "for i = 1, 10 do pcall(mino_board.get) end\n"
+        "busy(100000)\n");
+    scriptprof_stop(prof);
+    assert_int_equal(ok, LUA_OK);
+    scriptprof_end_frame(prof);
+
+    assert_true(scriptprof_get_samples(prof) > 0);
+    assert_int_equal(scriptprof_get_frames(prof), 1);
+
+    const scriptprof_calls_t* calls = scriptprof_get_calls(prof, "mino_board.get");
+    assert_non_null(calls);
+    assert_int_equal(calls->total, 10);
+    assert_int_equal(calls->last, 10);
+    assert_int_equal(calls->most, 10);
+    assert_int_equal(calls->frame, 0);
+    assert_null(scriptprof_get_calls(prof, "print"));
+
+    // Nothing is counted while we aren't profiling
+    uint64_t samples = scriptprof_get_samples(prof);
+    assert_int_equal(luaL_dostring(L, "for i = 1, 10000 do end"), LUA_OK);
+    assert_true(scriptprof_get_samples(prof) == samples);
+
+    // Every line is a collapsed stack followed by its sample count, and the
+    // busy function is where most of our time went
+    FILE* file = tmpfile();
+    assert_non_null(file);
+    assert_true(scriptprof_write_stacks(prof, file));
+    rewind(file);
+
+    char line[2048];
+    bool found = false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* count = strrchr(line, ' ');
+        assert_non_null(count);
+        assert_true(strtoul(count + 1, NULL, 10) > 0);
+        if (strstr(line, "busy (") != NULL) {
+            found = true;
+        }
+    }
+    assert_true(found);
+    fclose(file);
+
+    scriptprof_delete(prof);
+    script_closestate(L);
+
+    vfs_deinit();
+    platform_deinit();
+    frontend_deinit();
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_profile),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -37,7 +37,7 @@ static void test_serialize(void** state) {
 
     buffer_delete(serialized);
 
-    lua_close(L);
+    script_closestate(L);
 
     vfs_deinit();
     platform_deinit();